@@ -0,0 +1,101 @@
+#include <cstdio>
+#include <iostream>
+#include "checkpoint.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+checkpointWriter::~checkpointWriter() {
+    wait();
+}
+
+void checkpointWriter::write(const std::string& path, std::vector<char>&& data) {
+    wait();
+    thread = std::thread([path](std::vector<char> data) {
+        // written to a temporary file first, so an interrupted write never replaces a good checkpoint
+        const std::string tmpPath = path + ".tmp";
+        FILE* file = fopen(tmpPath.c_str(), "wb");
+        bool ok = file && fwrite(data.data(), 1, data.size(), file) == data.size();
+        if(file)
+            ok = fclose(file) == 0 && ok;
+        std::remove(path.c_str());
+        ok = ok && std::rename(tmpPath.c_str(), path.c_str()) == 0;
+        if(ok)
+            std::cout << "Checkpoint written to " << path << std::endl;
+        else
+            std::cout << "Cannot write checkpoint " << path << std::endl;
+    }, std::move(data));
+}
+
+void checkpointWriter::wait() {
+    if(thread.joinable())
+        thread.join();
+}
+
+mappedFile::~mappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+bool mappedFile::open(const char* path) {
+    close();
+    FILE* file = fopen(path, "rb");
+    if(!file)
+        return false;
+    fseek(file, 0, SEEK_END);
+    contents.resize(ftell(file));
+    fseek(file, 0, SEEK_SET);
+    const bool ok = fread(contents.data(), 1, contents.size(), file) == contents.size();
+    fclose(file);
+    if(!ok)
+        return false;
+    data = contents.data();
+    size = contents.size();
+    return true;
+}
+
+void mappedFile::close() {
+    contents.clear();
+    data = nullptr;
+    size = 0;
+}
+#else
+bool mappedFile::open(const char* path) {
+    close();
+    const int fd = ::open(path, O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+    if(mapping == MAP_FAILED)
+        return false;
+    data = (const char*)mapping;
+    size = st.st_size;
+    return true;
+}
+
+void mappedFile::close() {
+    if(data)
+        munmap((void*)data, size);
+    data = nullptr;
+    size = 0;
+}
+#endif
+
+const char* mappedFile::getData() const {
+    return data;
+}
+
+size_t mappedFile::getSize() const {
+    return size;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    Checkpoint file, native byte order:
+        checkpointHeader
+        config text     the general config the state was simulated with
+        particles       particleCount point structs, exactly as in memory
+    A file is only accepted if magic, version, byte order and pointSize all
+    match this build, so the particle block can be copied into the particle
+    store as it is.
+*/
+struct checkpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t headerSize;
+    uint32_t pointSize;
+    int32_t width, height;
+    int32_t cellSize, stencilRadius;
+    float h, K, p0, e, mass;
+    float dt;
+    int32_t generateCount;
+    int32_t activeTool;
+    uint64_t particleCount;
+    uint64_t configOffset, configSize;
+    uint64_t particleOffset;
+};
+
+const char checkpointMagic[8] = { 'F', 'S', 'I', 'M', 'C', 'K', 'P', 'T' };
+const uint32_t checkpointVersion = 1;
+const uint32_t checkpointByteOrder = 0x01020304;
+
+// writes a finished snapshot on a background thread, one at a time
+class checkpointWriter {
+private:
+    std::thread thread;
+
+public:
+    ~checkpointWriter();
+
+    // waits for the previous write, then writes data to path through a temporary file
+    void write(const std::string& path, std::vector<char>&& data);
+    void wait();
+};
+
+// read-only view of a whole file, memory mapped where available
+class mappedFile {
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    std::vector<char> contents;
+#endif
+
+public:
+    mappedFile() = default;
+    mappedFile(const mappedFile&) = delete;
+    mappedFile& operator=(const mappedFile&) = delete;
+    ~mappedFile();
+
+    bool open(const char* path);
+    void close();
+
+    const char* getData() const;
+    size_t getSize() const;
+};
@@ -1,14 +1,56 @@
 #include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include "fluid_sim.h"
-#include "renderer.h"
+#include "trajectory.h"
 #include "mouse.h"
 #include "ODE_solvers/ODESolver.h"
 #include "utils.h"
+#include "tracer.h"
+#include "global.h"
 #include "glm/glm.hpp"
+#ifdef FIXED_CONFIG
+#include "fixed_config.h"
+#endif
 
 #define PI 3.14159265359
 #define EPS 1e-6
 
+/*
+    Parameters read by the solver passes, copied into a local struct so the
+    compiler can keep them in registers instead of reloading them from the
+    object after every store to a particle. The FIXED_CONFIG build uses the
+    generated fixedParams instead, where all of them, the grid dimensions and
+    the stencil offsets are constexpr.
+*/
+struct runtimeParams {
+    float K;
+    float h;
+    float h2;
+    float p0;
+    float e;
+    float mass;
+    int cellSize;
+    int gridDimX;
+    int gridDimY;
+    int gridStride;
+    const sphKernels& kernels;
+};
+
+#ifdef FIXED_CONFIG
+#define SOLVER_PARAMS fixedParams()
+#else
+#define SOLVER_PARAMS runtimeParams { K, h, h2, p0, e, mass, cellSize, gridDimX, gridDimY, gridStride, kernels }
+#endif
+
+// flat index of the interior cell at row r, column c of the grid of prm with the stencil S
+template<class P, class S>
+static inline int stencilCell(const P& prm, const S&, int r, int c) {
+    return (r + S::radius) * prm.gridStride + (c + S::radius);
+}
+
 static void capMagnitude(glm::vec2& v, float maxMag) {
     float len = glm::length(v);
     if(len < EPS) {
@@ -19,145 +61,589 @@ static void capMagnitude(glm::vec2& v, float maxMag) {
         v *= maxMag / len;
 }
 
-void fluid_sim::setup(const libconfig::Config& cfg, int windowWidth, int windowHeight, ODESolver* integrator) {
+// the sorted cell lists of deterministic mode, indexed like grid
+struct sortedCells {
+    struct range {
+        point* const* first;
+        point* const* last;
+        point* const* begin() const { return first; }
+        point* const* end() const { return last; }
+    };
+
+    const int* start;
+    point* const* particles;
+
+    range operator[](int cell) const {
+        return { particles + start[cell], particles + start[cell + 1] };
+    }
+};
+
+/*
+    Dispatches on the stencil radius once per pass, so the passes are
+    instantiated per radius and their neighbour loops run over a std::array
+    of known size, which the compiler unrolls for the 3x3 stencil. Builds
+    specialized with make fixed pass the constexpr stencil of fixedParams.
+*/
+template<class F>
+void fluid_sim::withStencil(F&& pass) const {
+#ifdef FIXED_CONFIG
+    pass(fixedParams::stencil);
+#else
+    static_assert(maxStencilRadius == 3, "withStencil has to cover every radius");
+    switch(stencilRadius) {
+    case 1:
+        pass(std::get<0>(stencils));
+        break;
+    case 2:
+        pass(std::get<1>(stencils));
+        break;
+    default:
+        pass(std::get<2>(stencils));
+        break;
+    }
+#endif
+}
+
+// flat index of the interior cell at row r, column c
+inline int fluid_sim::cellIndex(int r, int c) const {
+    return (r + stencilRadius) * gridStride + (c + stencilRadius);
+}
+
+void fluid_sim::setup(const libconfig::Config& cfg, const libconfig::Config& utilsCfg, const char* configPath, int domainWidth, int domainHeight, ODESolver* integrator) {
     assert(integrator != nullptr);
     _integrator = integrator;
-    _renderer = new renderer();
-    _mouse = new mouse();
+    width = domainWidth;
+    height = domainHeight;
+    this->configPath = configPath;
+    bounceCoeff = utilsCfg.lookup("bounce_coeff");
+    groundBounceCoeff = utilsCfg.lookup("ground_bounce_coeff");
 
-    tickDuration = cfg.lookup("tick_duration");
+    setSeed((unsigned)cfg.lookup("seed"));
     num_iterations = cfg.lookup("num_iterations");
-    max_particles = cfg.lookup("max_particles");
+    const int maxParticles = cfg.lookup("max_particles");
+    if(maxParticles < 1)
+        throw std::runtime_error("max_particles must be positive");
+    max_particles = maxParticles;
     K = cfg.lookup("K");
     h = cfg.lookup("h");
     h2 = h * h;
-    h6 = pow(h, 0);
     p0 = cfg.lookup("p0");
     e = cfg.lookup("viscosity");
 
-    poly6_coeff = 315.0f / (64.0f * PI * pow(h, 0));
-    spiky_coeff = -45 / (PI * h6);
-    viscosity_lap_coeff = 45 / (PI * h6);
+    kernels = sphKernels(h);
 
     mass = cfg.lookup("mass");
     max_vel = cfg.lookup("max_vel");
     max_acc = cfg.lookup("max_acc");
 
-    mouse_coeff = cfg.lookup("mouse_coeff");
-    radius = cfg.lookup("particle_radius");
+    tools = parseInteractionTools(cfg.lookup("tools"));
+
+    sleep_vel = cfg.lookup("sleep_vel");
+    sleep_acc = cfg.lookup("sleep_acc");
+    sleep_steps = cfg.lookup("sleep_steps");
 
     cellSize = cfg.lookup("cell_size");
-    gridDimX = windowWidth / cellSize;
-    gridDimY = windowHeight / cellSize;
+    stencilRadius = cfg.lookup("stencil_radius");
+    if(stencilRadius < 1 || stencilRadius > maxStencilRadius)
+        throw std::runtime_error("stencil_radius must be between 1 and " + std::to_string(maxStencilRadius));
+    if(cellSize * stencilRadius < h)
+        throw std::runtime_error("cell_size * stencil_radius must be at least h");
 
-    grid = new std::unordered_set<point*>*[gridDimY];
-    gridLock = new omp_lock_t*[gridDimY];
-    for(int i = 0; i < gridDimY; i++) {
-        grid[i] = new std::unordered_set<point*>[gridDimX];
-        gridLock[i] = new omp_lock_t[gridDimX];
-        for(int j = 0; j < gridDimX; j++)
-            omp_init_lock(&gridLock[i][j]);
-    }
+#ifdef FIXED_CONFIG
+    if(K != fixedParams::K || h != fixedParams::h || p0 != fixedParams::p0 || e != fixedParams::e
+        || mass != fixedParams::mass || cellSize != fixedParams::cellSize || stencilRadius != fixedParams::stencilRadius
+        || width != fixedParams::width || height != fixedParams::height)
+        throw std::runtime_error("Config does not match the parameters this build was specialized for, rebuild with make fixed");
+#endif
+
+    // nothing is allocated before every lookup and check passed, so a setup that throws leaks nothing
+    pool.reserve(max_particles);
     points.reserve(max_particles);
+    _mouse = new mouse();
+    allocateGrid(cellSize, stencilRadius);
+}
+
+/*
+    (Re)builds the grid for the given layout. Existing particles are inserted
+    into their cells of the new grid, so this can be called while running.
+*/
+void fluid_sim::allocateGrid(int newCellSize, int newStencilRadius) {
+    cellSize = newCellSize;
+    stencilRadius = newStencilRadius;
+    gridDimX = (width + cellSize - 1) / cellSize;
+    gridDimY = (height + cellSize - 1) / cellSize;
 
-    running = _renderer->setup(windowWidth, windowHeight);
+    gridStride = gridDimX + 2 * stencilRadius;
+    const int numCells = gridStride * (gridDimY + 2 * stencilRadius);
+    grid = new std::unordered_set<point*>[numCells];
+    gridLock = new omp_lock_t[numCells];
+    for(int i = 0; i < numCells; i++)
+        omp_init_lock(&gridLock[i]);
 
-    lastUpdateTime = SDL_GetTicks();
+    stencils = { gridStencil<1>(gridStride), gridStencil<2>(gridStride), gridStencil<3>(gridStride) };
+
+    for(auto& p : points) {
+        p->gridIdx = { p->pos.x / cellSize, p->pos.y / cellSize };
+        grid[cellIndex(p->gridIdx.y, p->gridIdx.x)].insert(p);
+    }
 }
 
-bool fluid_sim::checkShouldUpdate() {
-    currentTime = SDL_GetTicks();
-    if(currentTime - lastUpdateTime >= tickDuration) {
-        // if(showFrameTime)
-        //     std::cout << "\rFrame time: " << currentTime - lastUpdateTime << " ms" << std::flush;
+void fluid_sim::freeGrid() {
+    const int numCells = gridStride * (gridDimY + 2 * stencilRadius);
+    for(int i = 0; i < numCells; i++)
+        omp_destroy_lock(&gridLock[i]);
 
-        // dt = (currentTime - lastUpdateTime) / (num_iterations * 4.0f);
+    delete[] grid;
+    delete[] gridLock;
+}
 
-        lastUpdateTime = currentTime;
-        return true;
+/*
+    Counting sort of the particles by cell. Scanning the particles in pool
+    order keeps every cell in ascending pool index, which depends only on the
+    order the particles were added in, not on the thread count or hashing.
+*/
+void fluid_sim::sortCells() {
+    const int numCells = gridStride * (gridDimY + 2 * stencilRadius);
+    cellStart.assign(numCells + 1, 0);
+    for(auto& p : points)
+        cellStart[cellIndex(p->gridIdx.y, p->gridIdx.x) + 1]++;
+    for(int i = 0; i < numCells; i++)
+        cellStart[i + 1] += cellStart[i];
+
+    cellParticles.resize(points.size());
+    std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+    for(auto& p : points)
+        cellParticles[fill[cellIndex(p->gridIdx.y, p->gridIdx.x)]++] = p;
+}
+
+void fluid_sim::setDeterministic(bool d) {
+    deterministic = d;
+}
+
+// hash of the position and velocity of every particle in pool order, equal for bitwise equal states
+uint64_t fluid_sim::stateHash() const {
+    const uint64_t count = points.size();
+    uint64_t hash = fnv1a(&count, sizeof(count));
+    for(auto& p : points) {
+        const glm::vec2 state[] = { p->pos, p->vel };
+        hash = fnv1a(state, sizeof(state), hash);
     }
-    return false;
+    return hash;
 }
 
-void fluid_sim::input() {
-    SDL_Event event;
-    int x, y;
-    while(SDL_PollEvent(&event)) {
-        switch(event.type) {
-        case SDL_QUIT:
-            running = false;
-            break;
-        case SDL_KEYDOWN:
-            if(event.key.keysym.sym == SDLK_ESCAPE)
-                running = false;
-            break;
-        case SDL_MOUSEMOTION:
-            x = event.motion.x;
-            y = event.motion.y;
-            _mouse->updatePos(x, y);
-            break;
-        case SDL_MOUSEBUTTONDOWN:
-            SDL_GetMouseState(&x, &y);
-            _mouse->updatePos(x, y);
-            if (!_mouse->getLB() && event.button.button == SDL_BUTTON_LEFT) {
-                _mouse->setLB(true);
-            }
-            if (!_mouse->getRB() && event.button.button == SDL_BUTTON_RIGHT) {
-                _mouse->setRB(true);
-            }
-            if (!_mouse->getSBX2() && event.button.button == SDL_BUTTON_X2) {
-                _mouse->setSBX2(true);
-            }
-            break;
-        case SDL_MOUSEBUTTONUP: 
-            if (_mouse->getLB() && event.button.button == SDL_BUTTON_LEFT) {
-                _mouse->setLB(false);
-            }
-            if (_mouse->getRB() && event.button.button == SDL_BUTTON_RIGHT) {
-                _mouse->setRB(false);
-            }
-            if (_mouse->getSBX2() && event.button.button == SDL_BUTTON_X2) {
-                _mouse->setSBX2(false);
-            }
-            break;
+// input from a front end, ignored while a recorded session is replayed
+void fluid_sim::userInput(const inputEvent& event) {
+    if(replay)
+        return;
+    if(recorder)
+        recorder->record(event);
+    applyInput(event);
+}
+
+void fluid_sim::applyInput(const inputEvent& event) {
+    switch(event.type) {
+    case inputType::MOVE:
+        _mouse->updatePos(event.a, event.b);
+        break;
+    case inputType::BUTTON_DOWN:
+    case inputType::BUTTON_UP: {
+        const bool down = event.type == inputType::BUTTON_DOWN;
+        if(down)
+            _mouse->updatePos(event.b, event.c);
+        if((inputButton)event.a == inputButton::LEFT)
+            _mouse->setLB(down);
+        else if((inputButton)event.a == inputButton::RIGHT)
+            _mouse->setRB(down);
+        else if((inputButton)event.a == inputButton::X2)
+            _mouse->setSBX2(down);
+        break;
+    }
+    case inputType::SELECT_TOOL:
+        if(event.a >= 0 && event.a < (int)tools.size()) {
+            activeTool = event.a;
+            std::cout << "Selected tool: " << getToolName(tools[activeTool].type) << std::endl;
         }
+        break;
+    default:
+        break;
     }
 }
 
 void fluid_sim::postInput() {
+    phaseTimer t(prof, phase::INPUT, false);
+    if(replay) {
+        inputEvent recorded;
+        while(replay->poll(substep, recorded))
+            applyInput(recorded);
+    }
+
     if(_mouse->getRB() && generateCount < maxGenerateCount) {
         const int genWidth = 150;
-        glm::ivec2 tl = { (_renderer->getWidth() - genWidth) / 2, 100 };
+        glm::ivec2 tl = { (width - genWidth) / 2, 100 };
         glm::ivec2 br = { tl.x + genWidth, 175 };
         generateParticles(tl, br, h);
         _mouse->setRB(false);
         generateCount++;
     }
+    if(_mouse->getLB() && tools[activeTool].type == toolType::SPAWN)
+        spawnInBrush(tools[activeTool]);
+}
+
+bool fluid_sim::addParticle(const glm::vec2& pos, const glm::vec2& vel) {
+    if(points.size() == max_particles)
+        return false;
+    const glm::ivec2 idx = { pos.x / cellSize, pos.y / cellSize };
+    if(idx.x < 0 || idx.x >= gridDimX || idx.y < 0 || idx.y >= gridDimY)
+        return false;
+    pool.push_back(point {
+        pos,
+        vel,
+        { 0, 0 },
+        idx,
+        0.0f,
+        0.0f,
+        false,
+        false,
+        0
+    });
+    point* p = &pool.back();
+    points.emplace_back(p);
+    grid[cellIndex(idx.y, idx.x)].insert(p);
+    return true;
+}
+
+/*
+    Removes the particle at index by moving the last particle into its slot,
+    so the pool stays contiguous and the index of the last particle changes.
+*/
+void fluid_sim::removeParticle(int index) {
+    if(index < 0 || index >= (int)pool.size())
+        throw std::runtime_error("Particle index out of range");
+    point* p = &pool[index];
+    point* last = &pool.back();
+    // neighbours resting against it have to react to the gap
+    wakeRegion(p->pos - h, p->pos + h);
+    grid[cellIndex(p->gridIdx.y, p->gridIdx.x)].erase(p);
+    if(p != last) {
+        grid[cellIndex(last->gridIdx.y, last->gridIdx.x)].erase(last);
+        *p = *last;
+        grid[cellIndex(p->gridIdx.y, p->gridIdx.x)].insert(p);
+    }
+    pool.pop_back();
+    points.pop_back();
 }
 
 void fluid_sim::generateParticles(const glm::ivec2& from, const glm::ivec2& to, float dist) {
+    // particles resting around the emitter have to react to the new ones
+    wakeRegion(glm::vec2(from) - h, glm::vec2(to) + h);
+
     for(int r = from.y; r < to.y; r += dist) {
         for(int c = from.x; c < to.x; c += dist) {
             if(points.size() == max_particles)
                 return;
-            point* p = new point {
-                { c, r },
-                { rand() % 1, 0 },
-                { 0, 0 },
-                { c / cellSize, r / cellSize },
-                0.0f,
-                0.0f,
-                false
-            };
-            points.emplace_back(p);
-            grid[p->gridIdx.y][p->gridIdx.x].insert(p);
+            addParticle({ c, r }, { rng() % 1, 0 });
+        }
+    }
+}
+
+// first and last + 1 index i with lo + i * spacing in [lo, hi) and in [0, extent)
+static void blockRange(float lo, float hi, float extent, float spacing, int64_t& first, int64_t& last) {
+    const double limit = 1e18;
+    first = (int64_t)std::min(limit, std::max(0.0, std::ceil(-(double)lo / spacing)));
+    last = (int64_t)std::min(limit, std::max(0.0, std::ceil(std::min((double)hi - lo, (double)extent - lo) / spacing)));
+}
+
+/*
+    Fills [from, to) with particles spacing apart at float coordinates. Only
+    the part of the block inside the grid is visited, so a tiny spacing stops
+    at max_particles instead of looping over positions that cannot be added.
+    Returns the number of particles added.
+*/
+int fluid_sim::addBlock(const glm::vec2& from, const glm::vec2& to, float spacing) {
+    if(!(spacing > 0) || !std::isfinite(spacing))
+        throw std::runtime_error("Block spacing must be positive");
+    if(!std::isfinite(from.x) || !std::isfinite(from.y) || !std::isfinite(to.x) || !std::isfinite(to.y))
+        throw std::runtime_error("Block corners must be finite");
+    if(to.x < from.x || to.y < from.y)
+        throw std::runtime_error("Block corners are inverted");
+    wakeRegion(from - h, to + h);
+
+    int64_t r0, r1, c0, c1;
+    blockRange(from.y, to.y, gridDimY * cellSize, spacing, r0, r1);
+    blockRange(from.x, to.x, gridDimX * cellSize, spacing, c0, c1);
+    int added = 0;
+    for(int64_t r = r0; r < r1; r++) {
+        for(int64_t c = c0; c < c1; c++) {
+            if(points.size() == max_particles)
+                return added;
+            added += addParticle({ from.x + (double)c * spacing, from.y + (double)r * spacing }, { 0, 0 });
+        }
+    }
+    return added;
+}
+
+// first and last row or column of the cells overlapping [lo, hi], clamped to the grid before converting, so any float is safe
+static void cellSpan(float lo, float hi, float cellSize, int dim, int& first, int& last) {
+    first = (int)std::max(0.0f, std::min((float)dim, std::floor(lo / cellSize)));
+    last = (int)std::max(-1.0f, std::min((float)dim - 1, std::floor(hi / cellSize)));
+}
+
+void fluid_sim::wakeRegion(const glm::vec2& from, const glm::vec2& to) {
+    int rmin, rmax, cmin, cmax;
+    cellSpan(from.y, to.y, cellSize, gridDimY, rmin, rmax);
+    cellSpan(from.x, to.x, cellSize, gridDimX, cmin, cmax);
+    for(int r = rmin; r <= rmax; r++) for(int c = cmin; c <= cmax; c++) {
+        for(auto& p : grid[cellIndex(r, c)]) {
+            p->locked = false;
+            p->disturbed = false;
+            p->restSteps = 0;
+        }
+    }
+}
+
+/*
+    Applies the active tool to the particles under the brush. Only the grid
+    cells overlapping the brush are visited, so the cost does not depend on
+    the total number of particles.
+*/
+void fluid_sim::applyInteraction() {
+    const interactionTool& tool = tools[activeTool];
+    if(!_mouse->getLB() || tool.type == toolType::SPAWN)
+        return;
+
+    const glm::vec2& center = _mouse->getPos();
+    const glm::vec2 diff = _mouse->getDiff();
+    const float r2max = tool.radius * tool.radius;
+    int rmin, rmax, cmin, cmax;
+    cellSpan(center.y - tool.radius, center.y + tool.radius, cellSize, gridDimY, rmin, rmax);
+    cellSpan(center.x - tool.radius, center.x + tool.radius, cellSize, gridDimX, cmin, cmax);
+    for(int r = rmin; r <= rmax; r++) for(int c = cmin; c <= cmax; c++) {
+        for(auto& p : grid[cellIndex(r, c)]) {
+            const glm::vec2 toMouse = center - p->pos;
+            if(glm::dot(toMouse, toMouse) < r2max) {
+                p->vel += tool.velocityDelta(toMouse, diff);
+                p->locked = false;
+                p->restSteps = 0;
+            }
+        }
+    }
+}
+
+// fills the free space under the brush with particles spaced by strength * h
+void fluid_sim::spawnInBrush(const interactionTool& tool) {
+    spawnInCircle(_mouse->getPos(), tool.radius, tool.strength * h);
+}
+
+// first lattice point center + i * spacing inside [center - radius, center + radius] and [0, extent], and how many follow
+static void latticeSpan(float center, float radius, float extent, float spacing, double& first, int64_t& count) {
+    const double lo = std::max((double)center - radius, 0.0), hi = std::min((double)center + radius, (double)extent);
+    first = std::max(lo, center + std::ceil((lo - center) / spacing) * spacing);
+    count = hi >= first ? (int64_t)std::min(1e18, std::floor((hi - first) / spacing)) + 1 : 0;
+}
+
+/*
+    Fills the free space of the circle with particles spaced by dist, returns
+    the number added. Only the lattice points inside the grid are visited,
+    so the cost does not depend on the radius.
+*/
+int fluid_sim::spawnInCircle(const glm::vec2& center, float radius, float dist) {
+    if(!(dist > 0) || !(radius > 0) || !std::isfinite(center.x) || !std::isfinite(center.y) || !std::isfinite(radius))
+        return 0;
+    const float minDist2 = 0.81f * dist * dist;
+    wakeRegion(center - radius - h, center + radius + h);
+
+    double x0, y0;
+    int64_t nx, ny;
+    latticeSpan(center.x, radius, gridDimX * cellSize, dist, x0, nx);
+    latticeSpan(center.y, radius, gridDimY * cellSize, dist, y0, ny);
+    int added = 0;
+    for(int64_t r = 0; r < ny; r++) {
+        for(int64_t c = 0; c < nx; c++) {
+            const glm::vec2 pos = { x0 + (double)c * dist, y0 + (double)r * dist };
+            if(glm::dot(pos - center, pos - center) > radius * radius)
+                continue;
+            if(pos.x < 0 || pos.y < 0 || pos.x >= gridDimX * cellSize || pos.y >= gridDimY * cellSize)
+                continue;
+
+            const int cell = cellIndex(pos.y / cellSize, pos.x / cellSize);
+            bool occupied = false;
+            withStencil([&](const auto& stencil) {
+                for(size_t k = 0; k < stencil.offsets.size() && !occupied; k++) {
+                    for(auto& q : grid[cell + stencil.offsets[k]]) {
+                        if(glm::dot(q->pos - pos, q->pos - pos) < minDist2) {
+                            occupied = true;
+                            break;
+                        }
+                    }
+                }
+            });
+            if(occupied)
+                continue;
+            if(!addParticle(pos, { 0, 0 }))
+                return added;
+            added++;
         }
     }
+    return added;
+}
+
+// adds dv to the velocity of every particle within radius of center and wakes them up
+void fluid_sim::applyImpulse(const glm::vec2& center, float radius, const glm::vec2& dv) {
+    const float r2max = radius * radius;
+    int rmin, rmax, cmin, cmax;
+    cellSpan(center.y - radius, center.y + radius, cellSize, gridDimY, rmin, rmax);
+    cellSpan(center.x - radius, center.x + radius, cellSize, gridDimX, cmin, cmax);
+    for(int r = rmin; r <= rmax; r++) for(int c = cmin; c <= cmax; c++) {
+        for(auto& p : grid[cellIndex(r, c)]) {
+            const glm::vec2 d = p->pos - center;
+            if(glm::dot(d, d) < r2max) {
+                p->vel += dv;
+                p->locked = false;
+                p->restSteps = 0;
+            }
+        }
+    }
+}
+
+int fluid_sim::getSleepingCount() const {
+    int count = 0;
+    for(auto& p : points)
+        count += p->locked;
+    return count;
+}
+
+/*
+    A particle falls asleep once both its speed and the change of its velocity
+    over a substep stay below the thresholds for sleep_steps substeps in a row.
+    Sleeping particles keep their last density and pressure, so awake
+    neighbours still see them, but they cost nothing to update.
+*/
+void fluid_sim::updateRestState(point* p, const glm::vec2& prevVel) {
+    if(sleep_steps <= 0)
+        return;
+    const glm::vec2 dv = p->vel - prevVel;
+    if(glm::dot(p->vel, p->vel) < sleep_vel * sleep_vel && glm::dot(dv, dv) < sleep_acc * sleep_acc * dt * dt)
+        p->restSteps++;
+    else
+        p->restSteps = 0;
+
+    if(p->restSteps >= sleep_steps) {
+        p->locked = true;
+        p->vel = { 0, 0 };
+        p->acc = { 0, 0 };
+    }
+}
+
+/*
+    Copies the state into a checkpoint image on the calling thread, between
+    steps, and leaves writing it to disk to a background thread.
+*/
+void fluid_sim::saveCheckpoint(const char* path) {
+    const std::string config = readFileContents(configPath.c_str());
+    checkpointHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, checkpointMagic, sizeof(header.magic));
+    header.version = checkpointVersion;
+    header.byteOrder = checkpointByteOrder;
+    header.headerSize = sizeof(checkpointHeader);
+    header.pointSize = sizeof(point);
+    header.width = width;
+    header.height = height;
+    header.cellSize = cellSize;
+    header.stencilRadius = stencilRadius;
+    header.h = h;
+    header.K = K;
+    header.p0 = p0;
+    header.e = e;
+    header.mass = mass;
+    header.dt = dt;
+    header.generateCount = generateCount;
+    header.activeTool = activeTool;
+    header.particleCount = pool.size();
+    header.configOffset = sizeof(checkpointHeader);
+    header.configSize = config.size();
+    header.particleOffset = header.configOffset + header.configSize;
+
+    std::vector<char> data(header.particleOffset + pool.size() * sizeof(point));
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(data.data() + header.configOffset, config.data(), config.size());
+    memcpy(data.data() + header.particleOffset, pool.data(), pool.size() * sizeof(point));
+    checkpoints.write(path, std::move(data));
+}
+
+/*
+    Replaces all particles with the ones of a checkpoint. The file is mapped
+    and its particle block copied into the pool in one go; only the grid is
+    rebuilt. The grid layout of the current config is used.
+*/
+void fluid_sim::loadCheckpoint(const char* path) {
+    mappedFile file;
+    if(!file.open(path))
+        throw std::runtime_error(std::string("Cannot open checkpoint ") + path);
+
+    checkpointHeader header;
+    if(file.getSize() < sizeof(header))
+        throw std::runtime_error(std::string(path) + " is not a checkpoint");
+    memcpy(&header, file.getData(), sizeof(header));
+    if(memcmp(header.magic, checkpointMagic, sizeof(header.magic)) != 0)
+        throw std::runtime_error(std::string(path) + " is not a checkpoint");
+    if(header.version != checkpointVersion || header.byteOrder != checkpointByteOrder
+        || header.headerSize != sizeof(checkpointHeader) || header.pointSize != sizeof(point))
+        throw std::runtime_error(std::string(path) + " was written by an incompatible version or platform");
+    // offsets and counts come from the file, so they are compared against its size without sums that could wrap
+    const uint64_t fileSize = file.getSize();
+    if(header.particleCount > max_particles)
+        throw std::runtime_error(std::string(path) + " holds more particles than max_particles");
+    if(header.particleOffset < sizeof(checkpointHeader) || header.particleOffset > fileSize
+        || header.particleCount > (fileSize - header.particleOffset) / sizeof(point))
+        throw std::runtime_error(std::string(path) + " is truncated");
+    if(header.width != width || header.height != height)
+        throw std::runtime_error(std::string(path) + " was saved for a " + std::to_string(header.width) + "x" + std::to_string(header.height) + " window");
+    // the grid is rebuilt from the positions, so every particle has to lie inside it
+    const char* particles = file.getData() + header.particleOffset;
+    for(uint64_t i = 0; i < header.particleCount; i++) {
+        glm::vec2 pos;
+        memcpy(&pos, particles + i * sizeof(point) + offsetof(point, pos), sizeof(pos));
+        if(!(pos.x >= 0 && pos.y >= 0 && pos.x < gridDimX * cellSize && pos.y < gridDimY * cellSize))
+            throw std::runtime_error(std::string(path) + " holds particles outside the domain");
+    }
+    if(header.h != h || header.K != K || header.p0 != p0 || header.e != e || header.mass != mass)
+        std::cout << "Checkpoint " << path << " was simulated with different fluid properties" << std::endl;
+
+    freeGrid();
+    pool.resize(header.particleCount);
+    memcpy(pool.data(), particles, header.particleCount * sizeof(point));
+    points.resize(header.particleCount);
+    for(size_t i = 0; i < pool.size(); i++)
+        points[i] = &pool[i];
+    allocateGrid(cellSize, stencilRadius);
+
+    dt = header.dt;
+    generateCount = header.generateCount;
+    if(header.activeTool >= 0 && header.activeTool < (int)tools.size())
+        activeTool = header.activeTool;
+}
+
+// runs steps without input until nearly all particles are asleep, or for maxSteps, and returns the steps run
+int fluid_sim::settle(int maxSteps, bool multithread) {
+    int step = 0;
+    while(step < maxSteps) {
+        if(multithread)
+            updateMultithread();
+        else
+            update();
+        step++;
+        if(sleep_steps > 0 && getSleepingCount() >= 0.95 * points.size())
+            break;
+    }
+    // the session starts from the settled state, as it does when that is loaded from the cache
+    substep = 0;
+    return step;
 }
 
 void fluid_sim::generateInitialParticles() {
     glm::ivec2 tl(0, 450);
-    glm::ivec2 br(_renderer->getWidth()-1, _renderer->getHeight()-11);
+    glm::ivec2 br(width-1, height-11);
     generateParticles(tl, br, h - 0.0001f);
 }
 
@@ -192,66 +678,83 @@ inline const char* fluid_sim::getMultithreadError() const {
     }
 }
 
-void fluid_sim::calcDensityAndPressure() {
-    for(int r = 0; r < gridDimY; r++)  for(int c = 0; c < gridDimX; c++) {
-        for(auto& p : grid[r][c]) {
+template<class P, class C, class S>
+void fluid_sim::calcDensityAndPressureImpl(const P& prm, const C& cells, const S& stencil) {
+    for(int r = 0; r < prm.gridDimY; r++)  for(int c = 0; c < prm.gridDimX; c++) {
+        const int cell = stencilCell(prm, stencil, r, c);
+        for(auto& p : cells[cell]) {
+            if(p->locked)
+                continue;
+
             // density
             p->density = 0;
-            const int irmin = std::max(0, r - 1), irmax = std::min(gridDimY - 1, r + 1);
-            const int icmin = std::max(0, c - 1), icmax = std::min(gridDimX - 1, c + 1);
-            for(int ir = irmin; ir <= irmax; ir++) for(int ic = icmin; ic <= icmax; ic++) {
-                for(auto& q : grid[ir][ic]) {
+            for(int offset : stencil.offsets) {
+                for(auto& q : cells[cell + offset]) {
                     const glm::vec2 diff = p->pos - q->pos;
                     const float r2 = glm::dot(diff, diff);
-                    if(r2 < h2) {
-                        const float W = poly6_coeff * (h2 - r2) * (h2 - r2) * (h2 - r2);
-                        p->density += mass * W;
+                    if(r2 < prm.h2) {
+                        p->density += prm.mass * prm.kernels.density.W(r2);
                     }
                 }
             }
-            if(isnan(p->density))
+            if(std::isnan(p->density))
                 throw std::runtime_error("Nan encountered in density");
             
-            p->density = std::max(p0, p->density);
+            p->density = std::max(prm.p0, p->density);
 
             // pressure
-            p->pressure = K * (p->density - p0);
-            if(isnan(p->pressure))
+            p->pressure = prm.K * (p->density - prm.p0);
+            if(std::isnan(p->pressure))
                 throw std::runtime_error("Nan encountered in pressure");
         }
     }
 }
 
-void fluid_sim::calcAcceleration() {
-    for(int r = 0; r < gridDimY; r++)  for(int c = 0; c < gridDimX; c++) {
-        for(auto& p : grid[r][c]) {
+void fluid_sim::calcDensityAndPressure() {
+    if(deterministic)
+        sortCells();
+    withStencil([&](const auto& stencil) {
+        if(deterministic)
+            calcDensityAndPressureImpl(SOLVER_PARAMS, sortedCells { cellStart.data(), cellParticles.data() }, stencil);
+        else
+            calcDensityAndPressureImpl(SOLVER_PARAMS, grid, stencil);
+    });
+}
+
+template<class P, class C, class S>
+void fluid_sim::calcAccelerationImpl(const P& prm, const C& cells, const S& stencil) {
+    for(int r = 0; r < prm.gridDimY; r++)  for(int c = 0; c < prm.gridDimX; c++) {
+        const int cell = stencilCell(prm, stencil, r, c);
+        for(auto& p : cells[cell]) {
+            if(p->locked)
+                continue;
+
+            // a moving particle disturbs its sleeping neighbours
+            const bool moving = glm::dot(p->vel, p->vel) >= sleep_vel * sleep_vel;
             p->acc = { 0, 0 };
-            const int irmin = std::max(0, r - 1), irmax = std::min(gridDimY - 1, r + 1);
-            const int icmin = std::max(0, c - 1), icmax = std::min(gridDimX - 1, c + 1);
-            for(int ir = irmin; ir <= irmax; ir++) for(int ic = icmin; ic <= icmax; ic++) {
-                for(auto& q : grid[ir][ic]) {
+            for(int offset : stencil.offsets) {
+                for(auto& q : cells[cell + offset]) {
                     if(q == p)
                         continue;
                     const glm::vec2 diff = p->pos - q->pos;
-                    const float r = glm::length(diff);
+                    const float r2 = glm::dot(diff, diff);
 
-                    if(r > EPS && r < h) {
-                        const float W_spiky = spiky_coeff * (h - r) * (h - r);
-                        const float W_lap = viscosity_lap_coeff * (h - r);
-                        p->acc -= (mass / mass) * ((p->pressure + q->pressure) / (2.0f * p->density * q->density)) * W_spiky * (diff / r);
-                        p->acc += e * (mass / mass) * (1.0f / q->density) * (q->vel - p->vel) * W_lap;
+                    if(r2 > EPS * EPS && r2 < prm.h2) {
+                        p->acc -= ((p->pressure + q->pressure) / (2.0f * p->density * q->density)) * prm.kernels.pressure.gradOverR(r2) * diff;
+                        p->acc += prm.e * (1.0f / q->density) * (q->vel - p->vel) * prm.kernels.viscosity.lap(r2);
+                        if(moving && q->locked)
+                            q->disturbed = true;
                     }
                 }
             }
-            if(p->pos.y >= _renderer->getHeight()-11) {
-                const glm::vec2 diff = { 0, p->pos.y - _renderer->getHeight() + 11 - h };
-                const float r = glm::length(diff);
-                if(r > EPS && r < h) {
-                    const float W_spiky = spiky_coeff * (h - r) * (h - r);
-                    p->acc -= p->pressure / (2.0f * p->density * p0) * W_spiky * (diff / r);
+            if(p->pos.y >= height-11) {
+                const glm::vec2 diff = { 0, p->pos.y - height + 11 - prm.h };
+                const float r2 = glm::dot(diff, diff);
+                if(r2 > EPS * EPS && r2 < prm.h2) {
+                    p->acc -= p->pressure / (2.0f * p->density * prm.p0) * prm.kernels.pressure.gradOverR(r2) * diff;
                 }
             }
-            if(isnan(p->acc.x) || isnan(p->acc.y))
+            if(std::isnan(p->acc.x) || std::isnan(p->acc.y))
                 throw std::runtime_error("Nan encountered in acc");
 
             // capMagnitude(p->acc, 0.5f);
@@ -259,252 +762,636 @@ void fluid_sim::calcAcceleration() {
     }
 }
 
+void fluid_sim::calcAcceleration() {
+    withStencil([&](const auto& stencil) {
+        if(deterministic)
+            calcAccelerationImpl(SOLVER_PARAMS, sortedCells { cellStart.data(), cellParticles.data() }, stencil);
+        else
+            calcAccelerationImpl(SOLVER_PARAMS, grid, stencil);
+    });
+}
+
 void fluid_sim::integrateMovements() {
     for(auto& p : points) {
         // _integrator.integrate(p->pos, p->vel, p->acc, dt);
 
         // calculate velocity
-        if(_mouse->getLB()) {
-            glm::vec2 toMouse = _mouse->getPos() - p->pos;
-            if(glm::dot(toMouse, toMouse) < 32 * 32)
-                p->vel += mouse_coeff * _mouse->getDiff();
+        if(p->locked) {
+            if(!p->disturbed)
+                continue;
+            p->locked = false;
+            p->disturbed = false;
+            p->restSteps = 0;
         }
+        const glm::vec2 prevVel = p->vel;
         _integrator->integrateStep1(p->pos, p->vel, p->acc, dt);
         capMagnitude(p->vel, max_vel);
         
         _integrator->integrateStep2(p->pos, p->vel, dt);
-        resolveOutOfBounds(*p, _renderer->getWidth()-1, _renderer->getHeight()-1);
+        resolveOutOfBounds(*p, width-1, height-1, bounceCoeff, groundBounceCoeff);
+        updateRestState(p, prevVel);
 
-        if(isnan(p->pos.x) || isnan(p->pos.y))
+        if(std::isnan(p->pos.x) || std::isnan(p->pos.y))
             throw std::runtime_error("Nan encountered in position");
-        
-        glm::ivec2 newIdx = { p->pos.x / cellSize, p->pos.y / cellSize };
+    }
+}
+
+template<class P>
+void fluid_sim::updateGridImpl(const P& prm) {
+    for(auto& p : points) {
+        if(p->locked)
+            continue;
+
+        glm::ivec2 newIdx = { p->pos.x / prm.cellSize, p->pos.y / prm.cellSize };
         if(p->gridIdx != newIdx) {
-            if(newIdx.x < 0 || newIdx.x >= gridDimX || newIdx.y < 0 || newIdx.y >= gridDimY)
+            if(newIdx.x < 0 || newIdx.x >= prm.gridDimX || newIdx.y < 0 || newIdx.y >= prm.gridDimY)
                 throw std::runtime_error("Index out of range");
             
-            grid[p->gridIdx.y][p->gridIdx.x].erase(p);
-            grid[newIdx.y][newIdx.x].insert(p);
+            grid[cellIndex(p->gridIdx.y, p->gridIdx.x)].erase(p);
+            grid[cellIndex(newIdx.y, newIdx.x)].insert(p);
             p->gridIdx = newIdx;
         }
     }
 }
 
-void fluid_sim::calcDensityAndPressureMultithread() {
+void fluid_sim::updateGrid() {
+    updateGridImpl(SOLVER_PARAMS);
+}
+
+template<class P, class C, class S>
+void fluid_sim::calcDensityAndPressureMultithreadImpl(const P& prm, const C& cells, const S& stencil) {
     #pragma omp parallel
     {
         multithread_exception mt_excpt_thread = NONE;
 
-        #pragma omp for collapse(2)
-        for(int r = 0; r < gridDimY; r++) for(int c = 0; c < gridDimX; c++) {
-            for(auto& p : grid[r][c]) {
-                // density
-                p->density = 0;
-                const int irmin = std::max(0, r - 1), irmax = std::min(gridDimY - 1, r + 1);
-                const int icmin = std::max(0, c - 1), icmax = std::min(gridDimX - 1, c + 1);
-                for(int ir = irmin; ir <= irmax; ir++) for(int ic = icmin; ic <= icmax; ic++) {
-                    for(auto& q : grid[ir][ic]) {
-                        const glm::vec2 diff = p->pos - q->pos;
-                        const float r2 = glm::dot(diff, diff);
-                        if(r2 < h2) {
-                            const float W = poly6_coeff * (h2 - r2) * (h2 - r2) * (h2 - r2);
-                            p->density += mass * W;
+        {
+            traceScope t("density loop");
+
+            #pragma omp for collapse(2) nowait
+            for(int r = 0; r < prm.gridDimY; r++) for(int c = 0; c < prm.gridDimX; c++) {
+                const int cell = stencilCell(prm, stencil, r, c);
+                for(auto& p : cells[cell]) {
+                    if(p->locked)
+                        continue;
+
+                    // density
+                    p->density = 0;
+                    for(int offset : stencil.offsets) {
+                        for(auto& q : cells[cell + offset]) {
+                            const glm::vec2 diff = p->pos - q->pos;
+                            const float r2 = glm::dot(diff, diff);
+                            if(r2 < prm.h2) {
+                                p->density += prm.mass * prm.kernels.density.W(r2);
+                            }
                         }
                     }
-                }
-                mt_excpt_thread = (isnan(p->density) && (mt_excpt_thread == NONE)) ? NAN_DENSITY : mt_excpt_thread;
+                    mt_excpt_thread = (std::isnan(p->density) && (mt_excpt_thread == NONE)) ? NAN_DENSITY : mt_excpt_thread;
 
-                p->density = std::max(p0, p->density);
+                    p->density = std::max(prm.p0, p->density);
 
-                // pressure
-                p->pressure = K * (p->density - p0);
+                    // pressure
+                    p->pressure = prm.K * (p->density - prm.p0);
 
-                mt_excpt_thread = (isnan(p->pressure) && (mt_excpt_thread == NONE)) ? NAN_PRESSURE : mt_excpt_thread;
+                    mt_excpt_thread = (std::isnan(p->pressure) && (mt_excpt_thread == NONE)) ? NAN_PRESSURE : mt_excpt_thread;
+                }
             }
         }
 
-        #pragma omp reduction(max:mt_excpt)
+        #pragma omp critical
         {
             mt_excpt = mt_excpt_thread > mt_excpt ? mt_excpt_thread : mt_excpt;
         }
     }
 }
 
-void fluid_sim::calcAccelerationMultithread() {
+void fluid_sim::calcDensityAndPressureMultithread() {
+    if(deterministic)
+        sortCells();
+    withStencil([&](const auto& stencil) {
+        if(deterministic)
+            calcDensityAndPressureMultithreadImpl(SOLVER_PARAMS, sortedCells { cellStart.data(), cellParticles.data() }, stencil);
+        else
+            calcDensityAndPressureMultithreadImpl(SOLVER_PARAMS, grid, stencil);
+    });
+}
+
+template<class P, class C, class S>
+void fluid_sim::calcAccelerationMultithreadImpl(const P& prm, const C& cells, const S& stencil) {
     #pragma omp parallel 
     {
         multithread_exception mt_excpt_thread = NONE;
         
-        #pragma omp for collapse(2)
-        for(int r = 0; r < gridDimY; r++) for(int c = 0; c < gridDimX; c++) {
-            for(auto& p : grid[r][c]) {
-                p->acc = { 0, 0 };
-                const int irmin = std::max(0, r - 1), irmax = std::min(gridDimY - 1, r + 1);
-                const int icmin = std::max(0, c - 1), icmax = std::min(gridDimX - 1, c + 1);
-                for(int ir = irmin; ir <= irmax; ir++) for(int ic = icmin; ic <= icmax; ic++) {
-                    for(auto& q : grid[ir][ic]) {
-                        if(q == p)
-                            continue;
-                        const glm::vec2 diff = p->pos - q->pos;
-                        const float r = glm::length(diff);
+        {
+            traceScope t("acceleration loop");
+
+            #pragma omp for collapse(2) nowait
+            for(int r = 0; r < prm.gridDimY; r++) for(int c = 0; c < prm.gridDimX; c++) {
+                const int cell = stencilCell(prm, stencil, r, c);
+                for(auto& p : cells[cell]) {
+                    if(p->locked)
+                        continue;
 
-                        if(r > EPS && r < h) {
-                            const float W_spiky = spiky_coeff * (h - r) * (h - r);
-                            const float W_lap = viscosity_lap_coeff * (h - r);
-                            p->acc -= (mass / mass) * ((p->pressure + q->pressure) / (2.0f * p->density * q->density)) * W_spiky * (diff / r);
-                            p->acc += e * (mass / mass) * (1.0f / q->density) * (q->vel - p->vel) * W_lap;
+                    // a moving particle disturbs its sleeping neighbours
+                    const bool moving = glm::dot(p->vel, p->vel) >= sleep_vel * sleep_vel;
+                    p->acc = { 0, 0 };
+                    for(int offset : stencil.offsets) {
+                        for(auto& q : cells[cell + offset]) {
+                            if(q == p)
+                                continue;
+                            const glm::vec2 diff = p->pos - q->pos;
+                            const float r2 = glm::dot(diff, diff);
+
+                            if(r2 > EPS * EPS && r2 < prm.h2) {
+                                p->acc -= ((p->pressure + q->pressure) / (2.0f * p->density * q->density)) * prm.kernels.pressure.gradOverR(r2) * diff;
+                                p->acc += prm.e * (1.0f / q->density) * (q->vel - p->vel) * prm.kernels.viscosity.lap(r2);
+                                if(moving && q->locked) {
+                                    #pragma omp atomic write
+                                    q->disturbed = true;
+                                }
+                            }
                         }
                     }
-                }
-                if(p->pos.y >= _renderer->getHeight()-11) {
-                    const glm::vec2 diff = { 0, p->pos.y - _renderer->getHeight() + 11 - h };
-                    const float r = glm::length(diff);
-                    if(r > EPS && r < h) {
-                        const float W_spiky = spiky_coeff * (h - r) * (h - r);
-                        p->acc -= p->pressure / (2.0f * p->density * p0) * W_spiky * (diff / r);
+                    if(p->pos.y >= height-11) {
+                        const glm::vec2 diff = { 0, p->pos.y - height + 11 - prm.h };
+                        const float r2 = glm::dot(diff, diff);
+                        if(r2 > EPS * EPS && r2 < prm.h2) {
+                            p->acc -= p->pressure / (2.0f * p->density * prm.p0) * prm.kernels.pressure.gradOverR(r2) * diff;
+                        }
                     }
+                    mt_excpt_thread = ((std::isnan(p->acc.x) || std::isnan(p->acc.y)) && (mt_excpt_thread == NONE)) ? NAN_ACC : mt_excpt_thread;
+                    // capMagnitude(p->acc, 0.5f);
                 }
-                mt_excpt_thread = ((isnan(p->acc.x) || isnan(p->acc.y)) && (mt_excpt_thread == NONE)) ? NAN_ACC : mt_excpt_thread;
-                // capMagnitude(p->acc, 0.5f);
             }
         }
 
-        #pragma omp reduction(max:mt_excpt)
+        #pragma omp critical
         {
             mt_excpt = mt_excpt_thread > mt_excpt ? mt_excpt_thread : mt_excpt;
         }
     }
 }
 
+void fluid_sim::calcAccelerationMultithread() {
+    withStencil([&](const auto& stencil) {
+        if(deterministic)
+            calcAccelerationMultithreadImpl(SOLVER_PARAMS, sortedCells { cellStart.data(), cellParticles.data() }, stencil);
+        else
+            calcAccelerationMultithreadImpl(SOLVER_PARAMS, grid, stencil);
+    });
+}
+
 void fluid_sim::integrateMovementsMultithread() {
     #pragma omp parallel 
     {
         multithread_exception mt_excpt_thread = NONE;
         
-        #pragma omp for
-        for(auto& p : points) {
-            // _integrator.integrate(p->pos, p->vel, p->acc, dt);
-
-            // calculate velocity
-            if(_mouse->getLB()) {
-                glm::vec2 toMouse = _mouse->getPos() - p->pos;
-                if(glm::dot(toMouse, toMouse) < 32 * 32)
-                    p->vel += mouse_coeff * _mouse->getDiff();
-            }
-            _integrator->integrateStep1(p->pos, p->vel, p->acc, dt);
-            capMagnitude(p->vel, max_vel);
+        {
+            traceScope t("integration loop");
+
+            #pragma omp for nowait
+            for(auto& p : points) {
+                // _integrator.integrate(p->pos, p->vel, p->acc, dt);
+
+                // calculate velocity
+                if(p->locked) {
+                    if(!p->disturbed)
+                        continue;
+                    p->locked = false;
+                    p->disturbed = false;
+                    p->restSteps = 0;
+                }
+                const glm::vec2 prevVel = p->vel;
+                _integrator->integrateStep1(p->pos, p->vel, p->acc, dt);
+                capMagnitude(p->vel, max_vel);
             
-            _integrator->integrateStep2(p->pos, p->vel, dt);
-            resolveOutOfBounds(*p, _renderer->getWidth()-1, _renderer->getHeight()-1);
-
-            mt_excpt_thread = ((isnan(p->pos.x) || isnan(p->pos.y)) && (mt_excpt_thread == NONE)) ? NAN_POS : mt_excpt_thread;
-
-            glm::ivec2 newIdx = { p->pos.x / cellSize, p->pos.y / cellSize };
-            if(p->gridIdx != newIdx) {
-                if(newIdx.x < 0 || newIdx.x >= gridDimX || newIdx.y < 0 || newIdx.y >= gridDimY) {
-                    mt_excpt_thread = IDX_OUT_OF_RANGE;
-                } else {
-                    // erase p from grid[p->gridIdx.y][p->gridIdx.x]
-                    omp_set_lock(&gridLock[p->gridIdx.y][p->gridIdx.x]);
-                    grid[p->gridIdx.y][p->gridIdx.x].erase(p);
-                    omp_unset_lock(&gridLock[p->gridIdx.y][p->gridIdx.x]);
-
-                    // insert p into grid[newIdx.y][newIdx.x]
-                    omp_set_lock(&gridLock[newIdx.y][newIdx.x]);
-                    grid[newIdx.y][newIdx.x].insert(p);
-                    omp_unset_lock(&gridLock[newIdx.y][newIdx.x]);
-
-                    // update grid index of p
-                    p->gridIdx = newIdx;
+                _integrator->integrateStep2(p->pos, p->vel, dt);
+                resolveOutOfBounds(*p, width-1, height-1, bounceCoeff, groundBounceCoeff);
+                updateRestState(p, prevVel);
+
+                mt_excpt_thread = ((std::isnan(p->pos.x) || std::isnan(p->pos.y)) && (mt_excpt_thread == NONE)) ? NAN_POS : mt_excpt_thread;
+            }
+        }
+
+        #pragma omp critical
+        {
+            mt_excpt = mt_excpt_thread > mt_excpt ? mt_excpt_thread : mt_excpt;
+        }
+    }
+}
+
+template<class P>
+void fluid_sim::updateGridMultithreadImpl(const P& prm) {
+    #pragma omp parallel 
+    {
+        multithread_exception mt_excpt_thread = NONE;
+        
+        {
+            traceScope t("grid loop");
+
+            #pragma omp for nowait
+            for(auto& p : points) {
+                if(p->locked)
+                    continue;
+
+                glm::ivec2 newIdx = { p->pos.x / prm.cellSize, p->pos.y / prm.cellSize };
+                if(p->gridIdx != newIdx) {
+                    if(newIdx.x < 0 || newIdx.x >= prm.gridDimX || newIdx.y < 0 || newIdx.y >= prm.gridDimY) {
+                        mt_excpt_thread = IDX_OUT_OF_RANGE;
+                    } else {
+                        const int oldCell = cellIndex(p->gridIdx.y, p->gridIdx.x);
+                        const int newCell = cellIndex(newIdx.y, newIdx.x);
+
+                        // erase p from its old cell
+                        omp_set_lock(&gridLock[oldCell]);
+                        grid[oldCell].erase(p);
+                        omp_unset_lock(&gridLock[oldCell]);
+
+                        // insert p into its new cell
+                        omp_set_lock(&gridLock[newCell]);
+                        grid[newCell].insert(p);
+                        omp_unset_lock(&gridLock[newCell]);
+
+                        // update grid index of p
+                        p->gridIdx = newIdx;
+                    }
                 }
             }
         }
 
-        #pragma omp reduction(max:mt_excpt)
+        #pragma omp critical
         {
             mt_excpt = mt_excpt_thread > mt_excpt ? mt_excpt_thread : mt_excpt;
         }
     }
 }
 
+void fluid_sim::updateGridMultithread() {
+    updateGridMultithreadImpl(SOLVER_PARAMS);
+}
+
 void fluid_sim::update() {
     for(int i = 0; i < num_iterations; i++) {
-        calcDensityAndPressure();
-        calcAcceleration();
-        integrateMovements();
+        {
+            phaseTimer t(prof, phase::DENSITY, false);
+            calcDensityAndPressure();
+        }
+        {
+            phaseTimer t(prof, phase::ACCELERATION, false);
+            calcAcceleration();
+        }
+        {
+            phaseTimer t(prof, phase::INTEGRATION, false);
+            applyInteraction();
+            integrateMovements();
+        }
+        {
+            phaseTimer t(prof, phase::GRID, false);
+            updateGrid();
+        }
+        finishSubstep(false);
     }
 }
 
 void fluid_sim::updateMultithread() {
     for(int i = 0; i < num_iterations; i++) {
-        calcDensityAndPressureMultithread();
+        {
+            phaseTimer t(prof, phase::DENSITY, true);
+            calcDensityAndPressureMultithread();
+        }
         if(mt_excpt != NONE)
             throw std::runtime_error(getMultithreadError());
         
-        calcAccelerationMultithread();
+        {
+            phaseTimer t(prof, phase::ACCELERATION, true);
+            calcAccelerationMultithread();
+        }
+        if(mt_excpt != NONE)
+            throw std::runtime_error(getMultithreadError());
+
+        {
+            phaseTimer t(prof, phase::INTEGRATION, true);
+            applyInteraction();
+            integrateMovementsMultithread();
+        }
         if(mt_excpt != NONE)
             throw std::runtime_error(getMultithreadError());
 
-        integrateMovementsMultithread();
+        {
+            phaseTimer t(prof, phase::GRID, true);
+            updateGridMultithread();
+        }
         if(mt_excpt != NONE)
             throw std::runtime_error(getMultithreadError());
+        finishSubstep(true);
     }
 }
 
-void fluid_sim::render() {
-    _renderer->clearScreen(0xFF000816);
+// hands the particles of every stride-th substep to the trajectory writer, which may wait for a free buffer
+void fluid_sim::finishSubstep(bool multithread) {
+    if(trajectory && substep % trajectory->getStride() == 0) {
+        const int n = points.size();
+        float* data = trajectory->beginFrame(substep, n);
+        #pragma omp parallel for if(multithread)
+        for(int i = 0; i < n; i++) {
+            data[4 * i] = points[i]->pos.x;
+            data[4 * i + 1] = points[i]->pos.y;
+            data[4 * i + 2] = points[i]->vel.x;
+            data[4 * i + 3] = points[i]->vel.y;
+        }
+        trajectory->commitFrame();
+    }
+    substep++;
+}
 
+stateSummary fluid_sim::collectStateSummary() const {
+    stateSummary summary = { (int)points.size(), 0, 0, 0, 0, 0, 0 };
+    double density = 0, speed = 0, energy = 0;
     for(auto& p : points) {
-        // uint8_t r = 0x55, g = 0xAA, b = 0xDD;
-        // float ratio = sqrt(glm::length(p->vel) / max_vel);
-        // r += (0xAA - 0x55) * ratio;
-        // g -= (0xAA - 0x55) * ratio;
-        // b -= (0xDD - 0x55) * ratio;
-        // uint32_t color = (0xFF << 24) | (r << 16) | (g << 8) | b;
-        _renderer->drawCircle(p->pos, radius, 0xFF55AADD);
+        const float v = glm::length(p->vel);
+        summary.sleeping += p->locked;
+        summary.maxDensity = std::max(summary.maxDensity, p->density);
+        summary.maxSpeed = std::max(summary.maxSpeed, v);
+        density += p->density;
+        speed += v;
+        energy += 0.5 * mass * v * v;
+    }
+    if(!points.empty()) {
+        summary.meanDensity = density / points.size();
+        summary.meanSpeed = speed / points.size();
+    }
+    summary.kineticEnergy = energy;
+    return summary;
+}
+
+neighbourStats fluid_sim::collectNeighbourStats() const {
+    neighbourStats stats;
+    stats.cellSize = cellSize;
+    stats.stencilRadius = stencilRadius;
+    for(int r = 0; r < gridDimY; r++) for(int c = 0; c < gridDimX; c++) {
+        const int cell = cellIndex(r, c);
+        stats.particlesPerCell.add(grid[cell].size());
+        for(auto& p : grid[cell]) {
+            int candidates = 0, neighbours = 0;
+            withStencil([&](const auto& stencil) {
+                for(int offset : stencil.offsets) {
+                    candidates += grid[cell + offset].size();
+                    for(auto& q : grid[cell + offset]) {
+                        const glm::vec2 diff = p->pos - q->pos;
+                        neighbours += glm::dot(diff, diff) < h2;
+                    }
+                }
+            });
+            stats.candidatesPerParticle.add(candidates);
+            stats.neighboursPerParticle.add(neighbours);
+        }
     }
+    return stats;
+}
+
+/*
+    Times the density and acceleration passes on the current particles for a
+    set of grid layouts (cell sizes of h, 1.5h and 2h with a 3x3 stencil, and
+    h/2, h/3 with the wider stencils) and keeps the fastest. The passes
+    overwrite density, pressure and acceleration, and the disturbed flags they
+    set on sleeping particles are restored afterwards, so the next step sees
+    the same state apart from the grid.
+*/
+void fluid_sim::autoTuneGrid(bool multithread, int repeats) {
+#ifdef FIXED_CONFIG
+    throw std::runtime_error("Grid tuning is not available in builds specialized for a fixed cell_size");
+#else
+    std::vector<glm::ivec2> layouts = {
+        { (int)std::ceil(h), 1 },
+        { (int)std::ceil(1.5f * h), 1 },
+        { (int)std::ceil(2.0f * h), 1 },
+        { (int)std::ceil(h / 2.0f), 2 },
+        { (int)std::ceil(h / 3.0f), 3 },
+        { cellSize, stencilRadius }
+    };
+
+    // the acceleration pass marks sleeping neighbours of moving particles, which would wake them on the next step
+    std::vector<char> disturbed(points.size());
+    for(size_t i = 0; i < points.size(); i++)
+        disturbed[i] = points[i]->disturbed;
+
+    glm::ivec2 best = { cellSize, stencilRadius };
+    double bestMs = -1;
+    std::cout << "tuning grid on " << points.size() << " particles (cell size, stencil radius: ms per substep, mean candidates, accepted)" << std::endl;
+    for(size_t i = 0; i < layouts.size(); i++) {
+        const glm::ivec2 layout = layouts[i];
+        if(layout.x < 1 || std::find(layouts.begin(), layouts.begin() + i, layout) != layouts.begin() + i)
+            continue;
+
+        freeGrid();
+        allocateGrid(layout.x, layout.y);
+        double ms = -1;
+        for(int k = 0; k <= repeats; k++) {
+            auto start = std::chrono::steady_clock::now();
+            if(multithread) {
+                calcDensityAndPressureMultithread();
+                if(mt_excpt == NONE)
+                    calcAccelerationMultithread();
+                if(mt_excpt != NONE)
+                    throw std::runtime_error(getMultithreadError());
+            } else {
+                calcDensityAndPressure();
+                calcAcceleration();
+            }
+            const double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            // the first run only warms up the caches of the new grid
+            if(k > 0 && (ms < 0 || elapsed < ms))
+                ms = elapsed;
+        }
+
+        const neighbourStats stats = collectNeighbourStats();
+        std::cout << "  " << layout.x << ", " << layout.y << ": " << ms << " ms, "
+                  << stats.candidatesPerParticle.mean() << ", " << 100.0 * stats.acceptance() << "%" << std::endl;
+        if(bestMs < 0 || ms < bestMs) {
+            bestMs = ms;
+            best = layout;
+        }
+    }
+
+    freeGrid();
+    allocateGrid(best.x, best.y);
+    for(size_t i = 0; i < points.size(); i++)
+        points[i]->disturbed = disturbed[i];
+    std::cout << "using cell size " << cellSize << ", stencil radius " << stencilRadius << std::endl;
+#endif
+}
+
+// curl of the velocity at p, from the SPH gradient of the pressure kernel
+float fluid_sim::vorticity(const point* p) const {
+    const int cell = cellIndex(p->gridIdx.y, p->gridIdx.x);
+    float w = 0;
+    withStencil([&](const auto& stencil) {
+        for(int offset : stencil.offsets) {
+            for(auto& q : grid[cell + offset]) {
+                const glm::vec2 diff = p->pos - q->pos;
+                const float r2 = glm::dot(diff, diff);
+                if(r2 > EPS * EPS && r2 < h2) {
+                    const glm::vec2 grad = kernels.pressure.gradOverR(r2) * diff;
+                    const glm::vec2 dv = q->vel - p->vel;
+                    w += mass / q->density * (dv.x * grad.y - dv.y * grad.x);
+                }
+            }
+        }
+    });
+    return w;
+}
+
+bool fluid_sim::finishFrame() {
+    const int reportInterval = 120;
+    if(!showFrameTime)
+        return false;
 
-    _renderer->render();
+    prof.endFrame();
+    if(prof.getFrameCount() % reportInterval != 0)
+        return false;
+    prof.print(std::cout);
+    return true;
 }
 
-bool fluid_sim::isRunning() const {
-    return running;
+profiler& fluid_sim::getProfiler() {
+    return prof;
 }
 
-Uint32 fluid_sim::getTickDuration() const {
-    return tickDuration;
+const profiler& fluid_sim::getProfiler() const {
+    return prof;
 }
 
 void fluid_sim::setShowFrameTime(bool ft) {
     showFrameTime = ft;
+    prof.setEnabled(ft);
 }
 
-mouse* const& fluid_sim::getMouseObject() const {
-    return _mouse;
+void fluid_sim::setTrajectoryWriter(trajectoryWriter* writer) {
+    trajectory = writer;
+}
+
+void fluid_sim::setInputRecorder(inputRecorder* r) {
+    recorder = r;
+}
+
+void fluid_sim::setInputReplay(inputReplay* r) {
+    replay = r;
+}
+
+void fluid_sim::setSeed(uint32_t s) {
+    seed = s;
+    rng.seed(s);
+}
+
+uint32_t fluid_sim::getSeed() const {
+    return seed;
 }
 
-float fluid_sim::getRadius() const {
-    return radius;
+long fluid_sim::getSubstep() const {
+    return substep;
+}
+
+// hardware counters are reported with the phase times, so this also turns those on
+bool fluid_sim::enablePerfCounters() {
+    setShowFrameTime(true);
+    return prof.enableCounters();
+}
+
+mouse* const& fluid_sim::getMouseObject() const {
+    return _mouse;
 }
 
 float fluid_sim::getH() const {
     return h;
 }
 
+const interactionTool& fluid_sim::getActiveTool() const {
+    return tools[activeTool];
+}
+
+void fluid_sim::setActiveTool(int idx) {
+    if(idx >= 0 && idx < (int)tools.size())
+        activeTool = idx;
+}
+
+int fluid_sim::getToolCount() const {
+    return tools.size();
+}
+
+const point* fluid_sim::getParticles(int& count) const {
+    count = pool.size();
+    return pool.data();
+}
+
+float fluid_sim::getParameter(const std::string& name) const {
+    if(name == "K")
+        return K;
+    if(name == "h")
+        return h;
+    if(name == "p0")
+        return p0;
+    if(name == "viscosity")
+        return e;
+    if(name == "mass")
+        return mass;
+    if(name == "max_vel")
+        return max_vel;
+    if(name == "max_acc")
+        return max_acc;
+    if(name == "sleep_vel")
+        return sleep_vel;
+    if(name == "sleep_acc")
+        return sleep_acc;
+    throw std::runtime_error("Unknown parameter: " + name);
+}
+
+/*
+    Changes a parameter between steps. h keeps the grid layout, so it can
+    only grow up to cell_size * stencil_radius. All particles are woken up,
+    since the state they came to rest in no longer holds.
+*/
+void fluid_sim::setParameter(const std::string& name, float value) {
+#ifdef FIXED_CONFIG
+    if(name == "K" || name == "h" || name == "p0" || name == "viscosity" || name == "mass")
+        throw std::runtime_error(name + " is compiled into builds specialized with make fixed");
+#endif
+    if(name == "K")
+        K = value;
+    else if(name == "h") {
+        if(value <= 0 || cellSize * stencilRadius < value)
+            throw std::runtime_error("h must be positive and at most cell_size * stencil_radius");
+        h = value;
+        h2 = h * h;
+        kernels = sphKernels(h);
+    } else if(name == "p0")
+        p0 = value;
+    else if(name == "viscosity")
+        e = value;
+    else if(name == "mass")
+        mass = value;
+    else if(name == "max_vel")
+        max_vel = value;
+    else if(name == "max_acc")
+        max_acc = value;
+    else if(name == "sleep_vel")
+        sleep_vel = value;
+    else if(name == "sleep_acc")
+        sleep_acc = value;
+    else
+        throw std::runtime_error("Unknown parameter: " + name);
+    wakeRegion({ 0, 0 }, { width, height });
+}
+
+int fluid_sim::getParticleCount() const {
+    return points.size();
+}
+
+int fluid_sim::getNumIterations() const {
+    return num_iterations;
+}
+
 void fluid_sim::destroy() {
-    for(int i = 0; i < gridDimY; i++) for(int j = 0; j < gridDimX; j++)
-        omp_destroy_lock(&gridLock[i][j]);
-    
-    for(int i = 0; i < gridDimY; i++) {
-        delete[] grid[i];
-        delete[] gridLock[i];
-    }
-    delete[] grid;
-    delete[] gridLock;
+    checkpoints.wait();
+    freeGrid();
 
-    for(auto& p : points)
-        delete p;
-    
     delete _mouse;
-    delete _renderer;
 }
\ No newline at end of file
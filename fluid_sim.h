@@ -1,15 +1,52 @@
 #pragma once
 #include <omp.h>
-#include <SDL2/SDL.h>
+#include <array>
+#include <cstdint>
 #include <iostream>
+#include <string>
+#include <random>
+#include <tuple>
 #include <vector>
 #include <unordered_set>
 #include <libconfig.h++>
 #include "glm/glm.hpp"
+#include "interaction.h"
+#include "kernels.h"
+#include "profiler.h"
+#include "neighbourstats.h"
+#include "checkpoint.h"
+#include "inputlog.h"
 
 struct point;
 
-class renderer;
+// aggregate state of all particles, reported per member by tools/ensemble.cpp
+struct stateSummary {
+    int particles;
+    int sleeping;
+    float meanDensity, maxDensity;
+    float meanSpeed, maxSpeed;
+    float kineticEnergy;
+};
+
+// largest stencil_radius, the solver passes are compiled for each radius up to it
+const int maxStencilRadius = 3;
+
+// flat offsets of the (2R + 1)^2 cells of the stencil from its centre cell in a grid of the given stride
+template<int R>
+struct gridStencil {
+    static constexpr int radius = R;
+    std::array<int, (2 * R + 1) * (2 * R + 1)> offsets{};
+
+    // constexpr so builds specialized with make fixed get the offsets as constants
+    constexpr explicit gridStencil(int stride = 0) {
+        int k = 0;
+        for(int dr = -R; dr <= R; dr++)
+            for(int dc = -R; dc <= R; dc++)
+                offsets[k++] = dr * stride + dc;
+    }
+};
+
+class trajectoryWriter;
 class mouse;
 class ODESolver;
 
@@ -24,77 +61,168 @@ private:
         NAN_DENSITY
     };
 
-    std::unordered_set<point*>** grid;
+    // cells are stored row-major with a ghost border stencilRadius cells wide
+    // that is always empty, so every interior cell has its full stencil and
+    // the stencil never needs bounds clamping
+    std::unordered_set<point*>* grid;
+    // particles are stored contiguously in pool, which is reserved for
+    // max_particles up front so the pointers in points and grid stay valid
+    std::vector<point> pool;
     std::vector<point*> points;
-    omp_lock_t** gridLock;
-    renderer* _renderer = nullptr;
+    omp_lock_t* gridLock;
     mouse* _mouse = nullptr;
     ODESolver* _integrator = nullptr;
 
     multithread_exception mt_excpt = NONE;
 
-    bool running = false;
-
-    Uint32 lastUpdateTime;
-    Uint32 currentTime;
-    Uint32 tickDuration;
     bool showFrameTime = false;
+    profiler prof;
+
+    int width;
+    int height;
+    std::string configPath;
+    float bounceCoeff;
+    float groundBounceCoeff;
 
     int generateCount = 0;
     int maxGenerateCount = 8;
     float dt = 1.0f;
-    float radius;
     int num_iterations;
-    int max_particles;
+    size_t max_particles;
     float K;
     float h;
     float h2;
-    float h6;
     float p0;
     float e;
-    float poly6_coeff;
-    float spiky_coeff;
-    float viscosity_lap_coeff;
+    sphKernels kernels;
     float mass;
     float max_vel;
     float max_acc;
-    float mouse_coeff;
+    float sleep_vel;
+    float sleep_acc;
+    int sleep_steps;
     int cellSize;
     int gridDimX;
     int gridDimY;
+    int gridStride;
+    // the stencil covers the (2 * stencilRadius + 1)^2 cells around a cell,
+    // cellSize * stencilRadius >= h so it contains every neighbour within h
+    int stencilRadius;
+    std::tuple<gridStencil<1>, gridStencil<2>, gridStencil<3>> stencils;
+
+    // deterministic mode sums over neighbours in the order of these lists
+    // instead of the hash order of the grid cells: the particles of cell i are
+    // cellParticles[cellStart[i] .. cellStart[i + 1]) in ascending pool index,
+    // rebuilt serially before every density pass
+    bool deterministic = false;
+    std::vector<int> cellStart;
+    std::vector<point*> cellParticles;
+
+    checkpointWriter checkpoints;
+
+    // substeps simulated since setup, every stride-th one is recorded to trajectory
+    long substep = 0;
+    trajectoryWriter* trajectory = nullptr;
+
+    // user input is recorded with the substep it was applied at, or replaced by a recorded session
+    inputRecorder* recorder = nullptr;
+    inputReplay* replay = nullptr;
+    // every random choice of the simulation is drawn from rng, so a seed and an input log reproduce a run
+    uint32_t seed;
+    std::mt19937 rng;
+
+    std::vector<interactionTool> tools;
+    int activeTool = 0;
 
 public:
     fluid_sim() = default;
     ~fluid_sim() = default;
 
-    bool isRunning() const;
-    Uint32 getTickDuration() const;
-
     void setShowFrameTime(bool ft);
+    bool enablePerfCounters();
+    void setTrajectoryWriter(trajectoryWriter* writer);
+    void setInputRecorder(inputRecorder* r);
+    void setInputReplay(inputReplay* r);
+    void setSeed(uint32_t s);
+    uint32_t getSeed() const;
+    long getSubstep() const;
 
     mouse* const& getMouseObject() const;
-    float getRadius() const;
     float getH() const;
-
-    void setup(const libconfig::Config& cfg, int windowWidth, int windowHeight, ODESolver* integrator);
-    bool checkShouldUpdate();
-    void input();
+    const interactionTool& getActiveTool() const;
+    void setActiveTool(int idx);
+    int getToolCount() const;
+    int getParticleCount() const;
+    // the particles in the order they were added, valid until particles are added or removed
+    const point* getParticles(int& count) const;
+    // solver parameters by their config name: K, h, p0, viscosity, mass, max_vel, max_acc, sleep_vel, sleep_acc
+    float getParameter(const std::string& name) const;
+    void setParameter(const std::string& name, float value);
+    int getNumIterations() const;
+
+    // cfg was read from configPath, which checkpoints embed; utilsCfg holds the boundary coefficients
+    void setup(const libconfig::Config& cfg, const libconfig::Config& utilsCfg, const char* configPath, int domainWidth, int domainHeight, ODESolver* integrator);
+    void userInput(const inputEvent& event);
+    void applyInput(const inputEvent& event);
     void postInput();
+    bool addParticle(const glm::vec2& pos, const glm::vec2& vel);
+    void removeParticle(int index);
     void generateParticles(const glm::ivec2& from, const glm::ivec2& to, float dist);
+    int addBlock(const glm::vec2& from, const glm::vec2& to, float spacing);
     void generateInitialParticles();
+    int settle(int maxSteps, bool multithread);
+    void wakeRegion(const glm::vec2& from, const glm::vec2& to);
+    int getSleepingCount() const;
+    void saveCheckpoint(const char* path);
+    void loadCheckpoint(const char* path);
 
     const char* getMultithreadError() const;
 
+    int cellIndex(int r, int c) const;
+    void allocateGrid(int newCellSize, int newStencilRadius);
+    void freeGrid();
+    neighbourStats collectNeighbourStats() const;
+    stateSummary collectStateSummary() const;
+    void autoTuneGrid(bool multithread, int repeats = 5);
+
+    void setDeterministic(bool d);
+    void sortCells();
+    uint64_t stateHash() const;
+
+    // solver passes, instantiated with the parameter set of the build (runtime config or fixed_config.h)
+    // and the cell storage they iterate, grid or the sorted cell lists of deterministic mode
+    // calls pass with the gridStencil of the current stencilRadius
+    template<class F> void withStencil(F&& pass) const;
+    template<class P, class C, class S> void calcDensityAndPressureImpl(const P& prm, const C& cells, const S& stencil);
+    template<class P, class C, class S> void calcAccelerationImpl(const P& prm, const C& cells, const S& stencil);
+    template<class P> void updateGridImpl(const P& prm);
+    template<class P, class C, class S> void calcDensityAndPressureMultithreadImpl(const P& prm, const C& cells, const S& stencil);
+    template<class P, class C, class S> void calcAccelerationMultithreadImpl(const P& prm, const C& cells, const S& stencil);
+    template<class P> void updateGridMultithreadImpl(const P& prm);
+
     void calcDensityAndPressure();
     void calcAcceleration();
     void integrateMovements();
+    void updateGrid();
     void update();
 
     void calcDensityAndPressureMultithread();
     void calcAccelerationMultithread();
     void integrateMovementsMultithread();
+    void updateGridMultithread();
     void updateMultithread();
 
-    void render();
+    void applyInteraction();
+    void spawnInBrush(const interactionTool& tool);
+    int spawnInCircle(const glm::vec2& center, float radius, float dist);
+    void applyImpulse(const glm::vec2& center, float radius, const glm::vec2& dv);
+    void updateRestState(point* p, const glm::vec2& prevVel);
+    void finishSubstep(bool multithread);
+
+    float vorticity(const point* p) const;
+    // returns true when the phase times were reported this frame
+    bool finishFrame();
+    profiler& getProfiler();
+    const profiler& getProfiler() const;
     void destroy();
 };
\ No newline at end of file
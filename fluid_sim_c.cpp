@@ -0,0 +1,167 @@
+#include <stdexcept>
+#include <cstddef>
+#include <string>
+#include <libconfig.h++>
+#include "glm/glm.hpp"
+#include "ODE_solvers/implicitEuler.h"
+#include "utils.h"
+#include "fluid_sim.h"
+#include "fluid_sim_c.h"
+#include "global.h"
+
+const char* argOpts = "";
+const char* generalConfigPath = "config/general.cfg";
+const char* utilsConfigPath = "config/utils.cfg";
+const char* traceOutputPath = "trace.json";
+const char* checkpointPath = "checkpoint.bin";
+
+// fsim_particles() hands out the particle store as it is
+static_assert(sizeof(fsim_particle) == sizeof(point), "fsim_particle does not match point");
+static_assert(offsetof(fsim_particle, vel) == offsetof(point, vel), "fsim_particle does not match point");
+static_assert(offsetof(fsim_particle, grid_idx) == offsetof(point, gridIdx), "fsim_particle does not match point");
+static_assert(offsetof(fsim_particle, density) == offsetof(point, density), "fsim_particle does not match point");
+static_assert(offsetof(fsim_particle, locked) == offsetof(point, locked), "fsim_particle does not match point");
+static_assert(offsetof(fsim_particle, rest_steps) == offsetof(point, restSteps), "fsim_particle does not match point");
+
+struct fsim {
+    // each simulation reads and remembers its own configs, the globals of global.h are left alone
+    std::string generalPath, utilsPath;
+    libconfig::Config cfg, utilsCfg;
+    implicitEuler* integrator = nullptr;
+    fluid_sim sim;
+    bool multithread = false;
+};
+
+static thread_local std::string lastError;
+
+static int fail(const std::exception& e) {
+    lastError = e.what();
+    return -1;
+}
+
+const char* fsim_last_error(void) {
+    return lastError.c_str();
+}
+
+fsim* fsim_create(const char* general_config, const char* utils_config, int width, int height) {
+    fsim* s = new fsim();
+    try {
+        s->generalPath = general_config ? general_config : "config/general.cfg";
+        s->utilsPath = utils_config ? utils_config : "config/utils.cfg";
+        parseConfig(s->cfg, s->generalPath.c_str());
+        parseConfig(s->utilsCfg, s->utilsPath.c_str());
+
+        glm::vec2 G;
+        G.x = s->cfg.lookup("gravity.x");
+        G.y = s->cfg.lookup("gravity.y");
+        s->integrator = new implicitEuler([=](float t, glm::vec2 y, glm::vec2 z, glm::vec2 zdash) -> glm::vec2 {
+            return zdash + G;
+        });
+        s->sim.setup(s->cfg, s->utilsCfg, s->generalPath.c_str(), width, height, (ODESolver*)s->integrator);
+    } catch(std::exception& e) {
+        fail(e);
+        delete s->integrator;
+        delete s;
+        return nullptr;
+    }
+    return s;
+}
+
+void fsim_destroy(fsim* sim) {
+    if(!sim)
+        return;
+    sim->sim.destroy();
+    delete sim->integrator;
+    delete sim;
+}
+
+int fsim_set_param(fsim* sim, const char* name, float value) {
+    try {
+        sim->sim.setParameter(name, value);
+    } catch(std::exception& e) {
+        return fail(e);
+    }
+    return 0;
+}
+
+int fsim_get_param(const fsim* sim, const char* name, float* value) {
+    try {
+        *value = sim->sim.getParameter(name);
+    } catch(std::exception& e) {
+        return fail(e);
+    }
+    return 0;
+}
+
+void fsim_set_multithread(fsim* sim, bool enabled) {
+    sim->multithread = enabled;
+}
+
+void fsim_set_deterministic(fsim* sim, bool enabled) {
+    sim->sim.setDeterministic(enabled);
+}
+
+int fsim_step(fsim* sim, int steps) {
+    try {
+        for(int i = 0; i < steps; i++) {
+            if(sim->multithread)
+                sim->sim.updateMultithread();
+            else
+                sim->sim.update();
+        }
+    } catch(std::exception& e) {
+        return fail(e);
+    }
+    return 0;
+}
+
+int fsim_add_particle(fsim* sim, float x, float y, float vx, float vy) {
+    if(!sim->sim.addParticle({ x, y }, { vx, vy })) {
+        lastError = "Particle outside the domain or max_particles reached";
+        return -1;
+    }
+    return sim->sim.getParticleCount() - 1;
+}
+
+int fsim_add_block(fsim* sim, float x0, float y0, float x1, float y1, float spacing) {
+    try {
+        return sim->sim.addBlock({ x0, y0 }, { x1, y1 }, spacing);
+    } catch(std::exception& e) {
+        return fail(e);
+    }
+}
+
+int fsim_remove_particle(fsim* sim, int index) {
+    try {
+        sim->sim.removeParticle(index);
+    } catch(std::exception& e) {
+        return fail(e);
+    }
+    return 0;
+}
+
+const fsim_particle* fsim_particles(const fsim* sim, int* count) {
+    int n;
+    const point* particles = sim->sim.getParticles(n);
+    if(count)
+        *count = n;
+    return reinterpret_cast<const fsim_particle*>(particles);
+}
+
+int fsim_save_checkpoint(fsim* sim, const char* path) {
+    try {
+        sim->sim.saveCheckpoint(path);
+    } catch(std::exception& e) {
+        return fail(e);
+    }
+    return 0;
+}
+
+int fsim_load_checkpoint(fsim* sim, const char* path) {
+    try {
+        sim->sim.loadCheckpoint(path);
+    } catch(std::exception& e) {
+        return fail(e);
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef FLUID_SIM_C_H
+#define FLUID_SIM_C_H
+#include <stdbool.h>
+
+/*
+    C interface of libfluidsim.a, the solver without the SDL front end.
+    Functions returning int return 0 on success and -1 on failure, with the
+    reason in fsim_last_error(). A simulation is not thread safe, but
+    separate simulations can be stepped on separate threads.
+
+    The library defines the globals of global.h (config paths, checkpoint
+    path), programs using this interface must not define them again.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct fsim fsim;
+
+// one particle exactly as the solver stores it, see point in utils.h
+typedef struct fsim_particle {
+    float pos[2];
+    float vel[2];
+    float acc[2];
+    int grid_idx[2];
+    float density;
+    float pressure;
+    bool locked;
+    bool disturbed;
+    int rest_steps;
+} fsim_particle;
+
+// reason of the last failure on the calling thread, valid until the next failure
+const char* fsim_last_error(void);
+
+/*
+    Creates an empty width x height domain from a general and a utils config,
+    NULL for config/general.cfg and config/utils.cfg. Each simulation keeps
+    its own configs, so simulations can be created from any thread. Returns
+    NULL on failure.
+*/
+fsim* fsim_create(const char* general_config, const char* utils_config, int width, int height);
+void fsim_destroy(fsim* sim);
+
+// solver parameters by their name in the general config: K, h, p0, viscosity, mass, max_vel, max_acc, sleep_vel, sleep_acc
+int fsim_set_param(fsim* sim, const char* name, float value);
+int fsim_get_param(const fsim* sim, const char* name, float* value);
+// step with the multithreaded solver on the OpenMP thread pool
+void fsim_set_multithread(fsim* sim, bool enabled);
+// sum over neighbours in a canonical order, see -d of the app
+void fsim_set_deterministic(fsim* sim, bool enabled);
+
+// runs steps steps of num_iterations substeps each
+int fsim_step(fsim* sim, int steps);
+
+// returns the index of the new particle, or -1 if it is outside the domain or max_particles is reached
+int fsim_add_particle(fsim* sim, float x, float y, float vx, float vy);
+// fills [x0, x1) x [y0, y1) with particles spacing apart, returns the number added, or -1 if
+// spacing is not positive or x1 < x0 or y1 < y0
+int fsim_add_block(fsim* sim, float x0, float y0, float x1, float y1, float spacing);
+// moves the last particle into the slot of the removed one
+int fsim_remove_particle(fsim* sim, int index);
+
+/*
+    The particle array itself, no copy is made. It stays valid until
+    particles are added or removed, stepping updates it in place.
+*/
+const fsim_particle* fsim_particles(const fsim* sim, int* count);
+
+int fsim_save_checkpoint(fsim* sim, const char* path);
+int fsim_load_checkpoint(fsim* sim, const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
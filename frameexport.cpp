@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
+#include "frameexport.h"
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+exportFormat parseExportFormat(const char* name) {
+    if(strcmp(name, "raw") == 0)
+        return exportFormat::RAW;
+    if(strcmp(name, "ppm") == 0)
+        return exportFormat::PPM;
+    if(strcmp(name, "pipe") == 0)
+        return exportFormat::PIPE;
+    throw std::runtime_error(std::string("Unknown export format: ") + name);
+}
+
+exportPolicy parseExportPolicy(const char* name) {
+    if(strcmp(name, "drop") == 0)
+        return exportPolicy::DROP;
+    if(strcmp(name, "throttle") == 0)
+        return exportPolicy::THROTTLE;
+    throw std::runtime_error(std::string("Unknown export policy: ") + name);
+}
+
+frameExporter::frameExporter(const char* target, exportFormat format, exportPolicy policy, int width, int height, int queueSize)
+    : target(target), format(format), policy(policy), width(width), height(height) {
+    buffers.resize(std::max(1, queueSize));
+    for(int i = 0; i < (int)buffers.size(); i++) {
+        buffers[i].resize(width * height);
+        freeBuffers.push_back(i);
+    }
+}
+
+frameExporter::~frameExporter() {
+    finish();
+}
+
+bool frameExporter::start() {
+    if(format == exportFormat::RAW)
+        out = fopen(target.c_str(), "wb");
+    else if(format == exportFormat::PIPE) {
+#ifndef _WIN32
+        // an encoder that exits early must fail the export, not kill the program on the next write
+        std::signal(SIGPIPE, SIG_IGN);
+#endif
+        out = popen(target.c_str(), "w");
+    }
+    if(format != exportFormat::PPM && !out)
+        return false;
+
+    writer = std::thread(&frameExporter::writeLoop, this);
+    return true;
+}
+
+void frameExporter::push(const Uint32* pixels) {
+    int buffer;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if(freeBuffers.empty()) {
+            if(policy == exportPolicy::DROP) {
+                dropped++;
+                return;
+            }
+            bufferFreed.wait(lock, [this] { return !freeBuffers.empty(); });
+        }
+        buffer = freeBuffers.front();
+        freeBuffers.pop_front();
+    }
+
+    // the buffer belongs to this thread until it is queued
+    memcpy(buffers[buffer].data(), pixels, width * height * sizeof(Uint32));
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queuedBuffers.push_back(buffer);
+    }
+    frameQueued.notify_one();
+}
+
+void frameExporter::writeLoop() {
+    std::vector<unsigned char> bytes(width * height * 4);
+    long index = 0;
+    while(true) {
+        int buffer;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            frameQueued.wait(lock, [this] { return stopping || !queuedBuffers.empty(); });
+            if(queuedBuffers.empty())
+                return;
+            buffer = queuedBuffers.front();
+            queuedBuffers.pop_front();
+        }
+
+        // after a write error the remaining frames are only recycled
+        const bool ok = !failed && writeFrame(buffers[buffer], index++, bytes);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            freeBuffers.push_back(buffer);
+            if(ok)
+                written++;
+            else
+                failed = true;
+        }
+        bufferFreed.notify_one();
+    }
+}
+
+bool frameExporter::writeFrame(const std::vector<Uint32>& pixels, long index, std::vector<unsigned char>& bytes) {
+    const int n = width * height;
+    if(format == exportFormat::PPM) {
+        for(int i = 0; i < n; i++) {
+            bytes[3 * i] = pixels[i] >> 16;
+            bytes[3 * i + 1] = pixels[i] >> 8;
+            bytes[3 * i + 2] = pixels[i];
+        }
+        char path[1024];
+        snprintf(path, sizeof(path), "%s_%05ld.ppm", target.c_str(), index);
+        FILE* file = fopen(path, "wb");
+        if(!file)
+            return false;
+        fprintf(file, "P6\n%d %d\n255\n", width, height);
+        const bool ok = fwrite(bytes.data(), 3, n, file) == (size_t)n;
+        return fclose(file) == 0 && ok;
+    }
+
+    for(int i = 0; i < n; i++) {
+        bytes[4 * i] = pixels[i] >> 16;
+        bytes[4 * i + 1] = pixels[i] >> 8;
+        bytes[4 * i + 2] = pixels[i];
+        bytes[4 * i + 3] = pixels[i] >> 24;
+    }
+    return fwrite(bytes.data(), 4, n, out) == (size_t)n;
+}
+
+void frameExporter::finish() {
+    if(!writer.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    frameQueued.notify_one();
+    writer.join();
+
+    if(format == exportFormat::PIPE)
+        pclose(out);
+    else if(out)
+        fclose(out);
+    out = nullptr;
+}
+
+long frameExporter::getWritten() const {
+    return written;
+}
+
+long frameExporter::getDropped() const {
+    return dropped;
+}
+
+bool frameExporter::hasFailed() const {
+    return failed;
+}
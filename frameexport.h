@@ -0,0 +1,69 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <cstdio>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class exportFormat {
+    RAW,    // RGBA frames appended to one file
+    PPM,    // one binary PPM per frame
+    PIPE    // RGBA frames written to the stdin of a command, e.g. an encoder
+};
+
+// what push() does when every buffer is waiting for the writer
+enum class exportPolicy {
+    DROP,       // skip the frame and count it
+    THROTTLE    // wait for the writer
+};
+
+exportFormat parseExportFormat(const char* name);
+exportPolicy parseExportPolicy(const char* name);
+
+/*
+    Writes frames on a background thread. push() copies an ARGB8888
+    framebuffer into one of a fixed number of buffers and queues it, so the
+    caller never waits on disk or pipe I/O unless the policy is THROTTLE and
+    the queue is full. Conversion to the output format happens on the writer.
+*/
+class frameExporter {
+private:
+    std::string target;
+    exportFormat format;
+    exportPolicy policy;
+    int width, height;
+
+    std::vector<std::vector<Uint32>> buffers;
+    std::deque<int> freeBuffers;
+    std::deque<int> queuedBuffers;
+    std::mutex mutex;
+    std::condition_variable bufferFreed;
+    std::condition_variable frameQueued;
+    std::thread writer;
+    bool stopping = false;
+
+    FILE* out = nullptr;
+    long written = 0;
+    long dropped = 0;
+    bool failed = false;
+
+    void writeLoop();
+    bool writeFrame(const std::vector<Uint32>& pixels, long index, std::vector<unsigned char>& bytes);
+
+public:
+    frameExporter(const char* target, exportFormat format, exportPolicy policy, int width, int height, int queueSize);
+    ~frameExporter();
+
+    // opens the output and starts the writer, returns false if the output cannot be opened
+    bool start();
+    void push(const Uint32* pixels);
+    // writes the queued frames and stops the writer
+    void finish();
+
+    long getWritten() const;
+    long getDropped() const;
+    bool hasFailed() const;
+};
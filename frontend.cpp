@@ -0,0 +1,384 @@
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include "frontend.h"
+#include "fluid_sim.h"
+#include "renderer.h"
+#include "rasterizer.h"
+#include "surface.h"
+#include "frameexport.h"
+#include "server.h"
+#include "inputlog.h"
+#include "profiler.h"
+#include "tracer.h"
+#include "utils.h"
+#include "global.h"
+
+const char* getRenderModeName(renderMode mode) {
+    switch(mode) {
+    case renderMode::RASTER:
+        return "raster";
+    case renderMode::SPRITES:
+        return "sprites";
+    case renderMode::SURFACE:
+        return "surface";
+    default:
+        return "unknown";
+    }
+}
+
+const char* getColorModeName(colorMode mode) {
+    switch(mode) {
+    case colorMode::NONE:
+        return "none";
+    case colorMode::VELOCITY:
+        return "velocity";
+    case colorMode::DENSITY:
+        return "density";
+    case colorMode::PRESSURE:
+        return "pressure";
+    case colorMode::VORTICITY:
+        return "vorticity";
+    default:
+        return "unknown";
+    }
+}
+
+static renderMode parseRenderMode(const std::string& name) {
+    for(int i = 0; i < (int)renderMode::COUNT; i++)
+        if(name == getRenderModeName((renderMode)i))
+            return (renderMode)i;
+    throw std::runtime_error("Unknown render mode: " + name);
+}
+
+void frontend::setRemote(simClient* client) {
+    remote = client;
+}
+
+profiler& frontend::getProfiler() {
+    return sim ? sim->getProfiler() : remoteProf;
+}
+
+const point* frontend::getParticles(int& count) const {
+    return sim ? sim->getParticles(count) : remote->getParticles(count);
+}
+
+void frontend::setup(const libconfig::Config& cfg, fluid_sim* simulation, int windowWidth, int windowHeight, bool headless) {
+    sim = simulation;
+    width = windowWidth;
+    height = windowHeight;
+
+    tickDuration = cfg.lookup("tick_duration");
+    radius = cfg.lookup("particle_radius");
+    const char* renderModeName = cfg.lookup("render_mode");
+    mode = parseRenderMode(renderModeName);
+    surfaceThreshold = cfg.lookup("surface_threshold");
+    surfaceCellSize = cfg.lookup("surface_cell_size");
+    if(surfaceCellSize < 1)
+        throw std::runtime_error("surface_cell_size must be at least 1");
+    remoteMaxVel = cfg.lookup("max_vel");
+    remoteP0 = cfg.lookup("p0");
+    numIterations = cfg.lookup("num_iterations");
+    h = sim ? sim->getH() : (float)cfg.lookup("h");
+    for(const interactionTool& tool : parseInteractionTools(cfg.lookup("tools"))) {
+        if(tool.type == toolType::PUSH)
+            remotePush = tool;
+        if(tool.type == toolType::SPAWN)
+            remoteSpawn = tool;
+    }
+
+    velocityPalette = palette::sqrtGradient(0xFF55AADD, 0xFFAA5555);
+    scalarPalette = palette::gradient(0xFF1A3A8A, 0xFFE8F4FF);
+    vorticityPalette = palette::diverging(0xFF3366FF, 0xFF55AADD, 0xFFFF5533);
+
+    // without a renderer SDL is never initialized, the caller drives update() directly
+    if(headless) {
+        running = true;
+        return;
+    }
+
+    _renderer = new renderer();
+    running = _renderer->setup(windowWidth, windowHeight);
+    _rasterizer = new rasterizer(windowWidth, windowHeight);
+    _surface = new densitySurface(windowWidth, windowHeight, surfaceCellSize, h);
+    running = running && _renderer->createCircleSprite(radius);
+
+    lastUpdateTime = SDL_GetTicks();
+}
+
+bool frontend::checkShouldUpdate() {
+    currentTime = SDL_GetTicks();
+    if(currentTime - lastUpdateTime >= tickDuration) {
+        // dt = (currentTime - lastUpdateTime) / (num_iterations * 4.0f);
+
+        lastUpdateTime = currentTime;
+        return true;
+    }
+    return false;
+}
+
+// window events, mouse and tool input is passed on to the simulation with the substep it happened at
+void frontend::input() {
+    phaseTimer t(getProfiler(), phase::INPUT, false);
+    SDL_Event event;
+    while(!isHeadless() && SDL_PollEvent(&event)) {
+        switch(event.type) {
+        case SDL_QUIT:
+            running = false;
+            break;
+        case SDL_KEYDOWN:
+            if(event.key.keysym.sym == SDLK_ESCAPE)
+                running = false;
+            if(remote) {
+                remoteInput(event);
+                break;
+            }
+            if(event.key.keysym.sym == SDLK_t && tracer::enabled) {
+                if(tracer::dump(traceOutputPath))
+                    std::cout << "Trace written to " << traceOutputPath << std::endl;
+            }
+            if(event.key.keysym.sym == SDLK_s)
+                sim->saveCheckpoint(checkpointPath);
+            if(event.key.keysym.sym == SDLK_r) {
+                mode = (renderMode)(((int)mode + 1) % (int)renderMode::COUNT);
+                std::cout << "Render mode: " << getRenderModeName(mode) << std::endl;
+            }
+            if(event.key.keysym.sym == SDLK_c) {
+                setColorMode((colorMode)(((int)coloring + 1) % (int)colorMode::COUNT));
+                std::cout << "Color mode: " << getColorModeName(coloring) << std::endl;
+            }
+            if(event.key.keysym.sym >= SDLK_1 && event.key.keysym.sym < SDLK_1 + sim->getToolCount())
+                sim->userInput({ sim->getSubstep(), inputType::SELECT_TOOL, event.key.keysym.sym - SDLK_1, 0, 0 });
+            break;
+        case SDL_MOUSEMOTION:
+            if(remote) {
+                remoteInput(event);
+                break;
+            }
+            sim->userInput({ sim->getSubstep(), inputType::MOVE, event.motion.x, event.motion.y, 0 });
+            break;
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP: {
+            if(remote) {
+                remoteInput(event);
+                break;
+            }
+            inputButton button;
+            if(event.button.button == SDL_BUTTON_LEFT)
+                button = inputButton::LEFT;
+            else if(event.button.button == SDL_BUTTON_RIGHT)
+                button = inputButton::RIGHT;
+            else if(event.button.button == SDL_BUTTON_X2)
+                button = inputButton::X2;
+            else
+                break;
+            if(event.type == SDL_MOUSEBUTTONDOWN) {
+                int x, y;
+                SDL_GetMouseState(&x, &y);
+                sim->userInput({ sim->getSubstep(), inputType::BUTTON_DOWN, (int)button, x, y });
+            } else {
+                sim->userInput({ sim->getSubstep(), inputType::BUTTON_UP, (int)button, 0, 0 });
+            }
+            break;
+        }
+        }
+    }
+}
+
+/*
+    Mouse and keys of a viewer, sent as server commands. A push covers the
+    substeps of a step at once, as the local push tool acts on each substep.
+*/
+void frontend::remoteInput(const SDL_Event& event) {
+    switch(event.type) {
+    case SDL_KEYDOWN:
+        if(event.key.keysym.sym == SDLK_r) {
+            mode = (renderMode)(((int)mode + 1) % (int)renderMode::COUNT);
+            std::cout << "Render mode: " << getRenderModeName(mode) << std::endl;
+        }
+        if(event.key.keysym.sym == SDLK_c) {
+            // the server streams positions and velocities only
+            setColorMode(coloring == colorMode::NONE ? colorMode::VELOCITY : colorMode::NONE);
+            std::cout << "Color mode: " << getColorModeName(coloring) << std::endl;
+        }
+        if(event.key.keysym.sym == SDLK_SPACE)
+            remote->send("pause");
+        if(event.key.keysym.sym == SDLK_RETURN)
+            remote->send("run");
+        break;
+    case SDL_MOUSEMOTION: {
+        const glm::vec2 pos = { event.motion.x, event.motion.y };
+        if(remoteDragging) {
+            const glm::vec2 dv = remotePush.velocityDelta({ 0, 0 }, pos - lastMouse) * (float)numIterations;
+            remote->send("force " + std::to_string(pos.x) + " " + std::to_string(pos.y) + " " + std::to_string(remotePush.radius)
+                + " " + std::to_string(dv.x) + " " + std::to_string(dv.y));
+        }
+        lastMouse = pos;
+        break;
+    }
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+        if(event.button.button == SDL_BUTTON_LEFT)
+            remoteDragging = event.type == SDL_MOUSEBUTTONDOWN;
+        if(event.button.button == SDL_BUTTON_RIGHT && event.type == SDL_MOUSEBUTTONDOWN)
+            remote->send("spawn " + std::to_string(event.button.x) + " " + std::to_string(event.button.y) + " " + std::to_string(remoteSpawn.radius));
+        lastMouse = { event.button.x, event.button.y };
+        break;
+    }
+}
+
+// positions and colours of all particles for the current render and colour mode
+void frontend::gatherRenderData() {
+    int n;
+    const point* particles = getParticles(n);
+    renderPositions.resize(n);
+    renderColors.resize(n);
+    const float maxVel = sim ? sim->getParameter("max_vel") : remoteMaxVel;
+    const float p0 = sim ? sim->getParameter("p0") : remoteP0;
+    const float velocityScale = 255.0f / (maxVel * maxVel);
+    const float scale = colorScale > 0 ? 255.0f / colorScale : 0.0f;
+    // the surface is not coloured per particle, and frames of a server carry no density or pressure
+    colorMode frameColoring = mode == renderMode::SURFACE ? colorMode::NONE : coloring;
+    if(remote && frameColoring != colorMode::VELOCITY)
+        frameColoring = colorMode::NONE;
+    float frameMax = 0;
+    #pragma omp parallel for reduction(max:frameMax)
+    for(int i = 0; i < n; i++) {
+        const point* p = &particles[i];
+        renderPositions[i] = p->pos;
+        switch(frameColoring) {
+        case colorMode::VELOCITY:
+            // the palette is indexed by the squared speed, see palette::sqrtGradient
+            renderColors[i] = velocityPalette[(int)(glm::dot(p->vel, p->vel) * velocityScale)];
+            break;
+        case colorMode::DENSITY:
+            frameMax = std::max(frameMax, p->density - p0);
+            renderColors[i] = scalarPalette[(int)((p->density - p0) * scale)];
+            break;
+        case colorMode::PRESSURE:
+            frameMax = std::max(frameMax, p->pressure);
+            renderColors[i] = scalarPalette[(int)(p->pressure * scale)];
+            break;
+        case colorMode::VORTICITY: {
+            const float w = sim->vorticity(p);
+            frameMax = std::max(frameMax, std::abs(w));
+            renderColors[i] = vorticityPalette[128 + (int)(0.5f * w * scale)];
+            break;
+        }
+        default:
+            renderColors[i] = 0xFF55AADD;
+            break;
+        }
+    }
+    colorScale = frameMax;
+}
+
+void frontend::render() {
+    {
+        phaseTimer t(getProfiler(), phase::RENDER, true);
+        gatherRenderData();
+
+        switch(mode) {
+        case renderMode::RASTER:
+            _rasterizer->drawCircles(renderPositions.data(), renderColors.data(), renderPositions.size(), radius, 0xFF000816);
+            _renderer->drawFramebuffer(_rasterizer->getPixels());
+            break;
+        case renderMode::SPRITES:
+            _renderer->clearScreen(0xFF000816);
+            _renderer->drawSprites(renderPositions.data(), renderColors.data(), renderPositions.size());
+            break;
+        case renderMode::SURFACE:
+            _surface->splat(renderPositions.data(), renderPositions.size());
+            _surface->shade(surfaceThreshold, 0xFF000816);
+            _renderer->drawFramebuffer(_surface->getPixels());
+            break;
+        default:
+            break;
+        }
+    }
+
+    if(getProfiler().isEnabled())
+        drawProfilerOverlay();
+
+    // presenting waits for vsync, so it is left out of the render phase
+    _renderer->render();
+}
+
+/*
+    Hands the current frame to the exporter. The windowed raster and surface
+    modes reuse the framebuffer render() drew, with sprites or headless the
+    particles are drawn offscreen.
+*/
+void frontend::exportFrame(frameExporter& exporter) {
+    if(_renderer && mode != renderMode::SPRITES) {
+        exporter.push(mode == renderMode::SURFACE ? _surface->getPixels() : _rasterizer->getPixels());
+        return;
+    }
+
+    if(!_rasterizer)
+        _rasterizer = new rasterizer(width, height);
+    if(!_surface)
+        _surface = new densitySurface(width, height, surfaceCellSize, h);
+    gatherRenderData();
+    if(mode == renderMode::SURFACE) {
+        _surface->splat(renderPositions.data(), renderPositions.size());
+        _surface->shade(surfaceThreshold, 0xFF000816);
+        exporter.push(_surface->getPixels());
+    } else {
+        _rasterizer->drawCircles(renderPositions.data(), renderColors.data(), renderPositions.size(), radius, 0xFF000816);
+        exporter.push(_rasterizer->getPixels());
+    }
+}
+
+/*
+    One bar per phase in the top left corner, its length is the mean time
+    per frame (20 px per ms) and the white tick marks the p99.
+*/
+void frontend::drawProfilerOverlay() {
+    const Uint32 colors[] = { 0xFFAAAAAA, 0xFF4488FF, 0xFFFF8844, 0xFF44DD66, 0xFFDDDD44, 0xFFDD44DD };
+    const float pxPerMs = 20.0f;
+    const profiler& prof = getProfiler();
+    for(int i = 0; i < (int)phase::COUNT; i++) {
+        const phaseStats stats = prof.getStats((phase)i);
+        const glm::vec2 pos = { 8, 8 + 10 * i };
+        _renderer->fillRect(pos, { std::max(1.0f, (float)stats.mean * pxPerMs), 6 }, colors[i]);
+        _renderer->fillRect(pos + glm::vec2((float)stats.p99 * pxPerMs, -1), { 2, 8 }, 0xFFFFFFFF);
+    }
+}
+
+void frontend::finishFrame() {
+    if(!sim || !sim->finishFrame() || !_renderer)
+        return;
+
+    const profiler& prof = sim->getProfiler();
+    double total = 0;
+    for(int i = 0; i < (int)phase::COUNT; i++)
+        total += prof.getStats((phase)i).mean;
+    const std::string title = "water sim - " + std::to_string(total) + " ms/frame";
+    _renderer->setTitle(title.c_str());
+}
+
+bool frontend::isHeadless() const {
+    return _renderer == nullptr;
+}
+
+bool frontend::isRunning() const {
+    return running;
+}
+
+Uint32 frontend::getTickDuration() const {
+    return tickDuration;
+}
+
+void frontend::setColorMode(colorMode mode) {
+    coloring = mode;
+    colorScale = 0;
+}
+
+void frontend::destroy() {
+    delete _surface;
+    delete _rasterizer;
+    delete _renderer;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <vector>
+#include <libconfig.h++>
+#include "glm/glm.hpp"
+#include "palette.h"
+#include "profiler.h"
+#include "interaction.h"
+
+class fluid_sim;
+class simClient;
+struct point;
+class renderer;
+class rasterizer;
+class densitySurface;
+class frameExporter;
+
+// how particles are drawn, selected with render_mode in the config and cycled with R
+enum class renderMode {
+    RASTER,     // CPU rasterizer uploaded as one texture
+    SPRITES,    // one SDL_RenderGeometry call with a quad per particle
+    SURFACE,    // thresholded density field splatted onto a coarse grid
+    COUNT
+};
+
+const char* getRenderModeName(renderMode mode);
+
+// quantity particles are coloured by, enabled for velocity with -c and cycled with C
+enum class colorMode {
+    NONE,
+    VELOCITY,
+    DENSITY,
+    PRESSURE,
+    VORTICITY,
+    COUNT
+};
+
+const char* getColorModeName(colorMode mode);
+
+/*
+    SDL window on top of a fluid_sim: turns window events into simulation
+    input and draws the particles. Headless it opens no window and SDL is
+    never initialized, but frames can still be exported. As a viewer of a
+    simulation server (setRemote()) it draws the frames the server streams
+    and sends the mouse tools as commands instead.
+*/
+class frontend {
+private:
+    fluid_sim* sim = nullptr;
+    simClient* remote = nullptr;
+    // stays disabled for a remote simulation, whose phases are timed by the server
+    profiler remoteProf;
+    // the left button pushes the remote fluid along the mouse like the push tool, the right one spawns
+    interactionTool remotePush = { toolType::PUSH, 32.0f, 0.01f };
+    interactionTool remoteSpawn = { toolType::SPAWN, 16.0f, 1.0f };
+    bool remoteDragging = false;
+    glm::vec2 lastMouse;
+    // parameters of the config the server was started with
+    float remoteMaxVel;
+    float remoteP0;
+    int numIterations;
+    renderer* _renderer = nullptr;
+    rasterizer* _rasterizer = nullptr;
+    densitySurface* _surface = nullptr;
+    int width;
+    int height;
+    float radius;
+    float h;
+    int surfaceCellSize;
+    float surfaceThreshold;
+    renderMode mode = renderMode::RASTER;
+    colorMode coloring = colorMode::NONE;
+    palette velocityPalette;
+    palette scalarPalette;
+    palette vorticityPalette;
+    // largest magnitude of the coloured quantity in the previous frame, maps it to the full palette
+    float colorScale = 0;
+    // particle positions and colours gathered for drawing each frame
+    std::vector<glm::vec2> renderPositions;
+    std::vector<Uint32> renderColors;
+
+    bool running = false;
+
+    Uint32 lastUpdateTime;
+    Uint32 currentTime;
+    Uint32 tickDuration;
+
+    profiler& getProfiler();
+    const point* getParticles(int& count) const;
+    void remoteInput(const SDL_Event& event);
+    void gatherRenderData();
+    void drawProfilerOverlay();
+
+public:
+    // draw the frames of a simulation server instead of a local simulation, before setup() with a null simulation
+    void setRemote(simClient* client);
+    void setup(const libconfig::Config& cfg, fluid_sim* simulation, int windowWidth, int windowHeight, bool headless = false);
+
+    bool isHeadless() const;
+    bool isRunning() const;
+    Uint32 getTickDuration() const;
+    void setColorMode(colorMode mode);
+
+    bool checkShouldUpdate();
+    void input();
+    void render();
+    void exportFrame(frameExporter& exporter);
+    void finishFrame();
+    void destroy();
+};
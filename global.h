@@ -2,4 +2,6 @@
 
 extern const char* argOpts;
 extern const char* generalConfigPath;
-extern const char* utilsConfigPath;
\ No newline at end of file
+extern const char* utilsConfigPath;
+extern const char* traceOutputPath;
+extern const char* checkpointPath;
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include <cinttypes>
+#include <cstring>
+#include <stdexcept>
+#include "inputlog.h"
+
+static const char* typeNames[] = { "move", "down", "up", "tool", "end" };
+
+inputRecorder::~inputRecorder() {
+    if(out)
+        fclose(out);
+}
+
+bool inputRecorder::open(const char* path, uint32_t seed, uint64_t configHash) {
+    out = fopen(path, "w");
+    if(!out)
+        return false;
+    fprintf(out, "fsim-input 1\nseed %" PRIu32 "\nconfig %016" PRIx64 "\n", seed, configHash);
+    return true;
+}
+
+void inputRecorder::record(const inputEvent& event) {
+    if(!out)
+        return;
+    fprintf(out, "%ld %s", event.substep, typeNames[(int)event.type]);
+    switch(event.type) {
+    case inputType::MOVE:
+        fprintf(out, " %d %d\n", event.a, event.b);
+        break;
+    case inputType::BUTTON_DOWN:
+        fprintf(out, " %d %d %d\n", event.a, event.b, event.c);
+        break;
+    case inputType::BUTTON_UP:
+    case inputType::SELECT_TOOL:
+        fprintf(out, " %d\n", event.a);
+        break;
+    default:
+        fprintf(out, "\n");
+        break;
+    }
+}
+
+void inputRecorder::close(long substep) {
+    if(!out)
+        return;
+    record({ substep, inputType::END, 0, 0, 0 });
+    fclose(out);
+    out = nullptr;
+}
+
+void inputReplay::open(const char* path) {
+    FILE* in = fopen(path, "r");
+    if(!in)
+        throw std::runtime_error(std::string("Cannot open input log ") + path);
+
+    int version = 0;
+    if(fscanf(in, "fsim-input %d seed %" SCNu32 " config %" SCNx64, &version, &seed, &configHash) != 3 || version != 1) {
+        fclose(in);
+        throw std::runtime_error(std::string("Not an input log: ") + path);
+    }
+
+    events.clear();
+    next = 0;
+    bool ended = false;
+    long substep;
+    char type[8];
+    while(!ended && fscanf(in, "%ld %7s", &substep, type) == 2) {
+        inputEvent event = { substep, inputType::END, 0, 0, 0 };
+        int fields = 0, expected = 0;
+        if(strcmp(type, "move") == 0) {
+            event.type = inputType::MOVE;
+            fields = fscanf(in, "%d %d", &event.a, &event.b);
+            expected = 2;
+        } else if(strcmp(type, "down") == 0) {
+            event.type = inputType::BUTTON_DOWN;
+            fields = fscanf(in, "%d %d %d", &event.a, &event.b, &event.c);
+            expected = 3;
+        } else if(strcmp(type, "up") == 0 || strcmp(type, "tool") == 0) {
+            event.type = type[0] == 'u' ? inputType::BUTTON_UP : inputType::SELECT_TOOL;
+            fields = fscanf(in, "%d", &event.a);
+            expected = 1;
+        } else if(strcmp(type, "end") == 0) {
+            endSubstep = substep;
+            ended = true;
+        } else {
+            expected = -1;
+        }
+        if(fields != expected || (!events.empty() && substep < events.back().substep)) {
+            fclose(in);
+            throw std::runtime_error(std::string("Malformed event in input log ") + path);
+        }
+        if(!ended)
+            events.push_back(event);
+    }
+    fclose(in);
+    // a session that did not exit cleanly ends with its last event
+    if(!ended)
+        endSubstep = events.empty() ? 0 : events.back().substep;
+}
+
+uint32_t inputReplay::getSeed() const {
+    return seed;
+}
+
+uint64_t inputReplay::getConfigHash() const {
+    return configHash;
+}
+
+long inputReplay::getEndSubstep() const {
+    return endSubstep;
+}
+
+bool inputReplay::poll(long substep, inputEvent& event) {
+    if(next == events.size() || events[next].substep > substep)
+        return false;
+    event = events[next++];
+    return true;
+}
+
+bool inputReplay::finished(long substep) const {
+    return next == events.size() && substep >= endSubstep;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+    Input log, one event per line after a short header:
+        fsim-input 1
+        seed <seed of the particle generator>
+        config <hash of the configs the session ran with>
+        <substep> move <x> <y>
+        <substep> down <button> <x> <y>
+        <substep> up <button>
+        <substep> tool <index>
+        <substep> end
+    Events are stamped with the substep they were applied before, so a replay
+    feeds them at the same point of the simulation however fast it runs.
+*/
+enum class inputType {
+    MOVE,
+    BUTTON_DOWN,
+    BUTTON_UP,
+    SELECT_TOOL,
+    END
+};
+
+enum class inputButton {
+    LEFT,
+    RIGHT,
+    X2
+};
+
+struct inputEvent {
+    long substep;
+    inputType type;
+    int a, b, c;    // x, y for MOVE; button, x, y for BUTTON_DOWN; button for BUTTON_UP; index for SELECT_TOOL
+};
+
+class inputRecorder {
+private:
+    FILE* out = nullptr;
+
+public:
+    inputRecorder() = default;
+    inputRecorder(const inputRecorder&) = delete;
+    inputRecorder& operator=(const inputRecorder&) = delete;
+    ~inputRecorder();
+
+    // returns false if the file cannot be created
+    bool open(const char* path, uint32_t seed, uint64_t configHash);
+    void record(const inputEvent& event);
+    // writes the end marker at substep and closes the file
+    void close(long substep);
+};
+
+// loads a whole input log, throws std::runtime_error if it is malformed
+class inputReplay {
+private:
+    std::vector<inputEvent> events;
+    size_t next = 0;
+    uint32_t seed = 0;
+    uint64_t configHash = 0;
+    long endSubstep = 0;
+
+public:
+    void open(const char* path);
+
+    uint32_t getSeed() const;
+    uint64_t getConfigHash() const;
+    long getEndSubstep() const;
+
+    // takes the next event due before substep, returns false when there is none
+    bool poll(long substep, inputEvent& event);
+    bool finished(long substep) const;
+};
@@ -0,0 +1,60 @@
+#include <stdexcept>
+#include <cstring>
+#include "interaction.h"
+
+glm::vec2 interactionTool::velocityDelta(const glm::vec2& toMouse, const glm::vec2& mouseDiff) const {
+    switch(type) {
+    case toolType::PUSH:
+        return strength * mouseDiff;
+    case toolType::PULL:
+        return strength * toMouse / radius;
+    case toolType::VORTEX:
+        return strength * glm::vec2(-toMouse.y, toMouse.x) / radius;
+    default:
+        return { 0, 0 };
+    }
+}
+
+const char* getToolName(toolType type) {
+    switch(type) {
+    case toolType::PUSH:
+        return "push";
+    case toolType::PULL:
+        return "pull";
+    case toolType::VORTEX:
+        return "vortex";
+    case toolType::SPAWN:
+        return "spawn";
+    default:
+        return "unknown";
+    }
+}
+
+std::vector<interactionTool> parseInteractionTools(const libconfig::Setting& list) {
+    std::vector<interactionTool> tools;
+    for(int i = 0; i < list.getLength(); i++) {
+        const libconfig::Setting& s = list[i];
+        const char* name = s.lookup("type");
+        interactionTool tool;
+        if(strcmp(name, "push") == 0)
+            tool.type = toolType::PUSH;
+        else if(strcmp(name, "pull") == 0)
+            tool.type = toolType::PULL;
+        else if(strcmp(name, "vortex") == 0)
+            tool.type = toolType::VORTEX;
+        else if(strcmp(name, "spawn") == 0)
+            tool.type = toolType::SPAWN;
+        else
+            throw std::runtime_error(std::string("Unknown interaction tool: ") + name);
+        tool.radius = s.lookup("radius");
+        tool.strength = s.lookup("strength");
+        if(!(tool.radius > 0))
+            throw std::runtime_error(std::string("Radius of the ") + name + " tool must be positive");
+        if(tool.type == toolType::SPAWN && !(tool.strength > 0))
+            throw std::runtime_error("Strength of the spawn tool must be positive");
+        tools.push_back(tool);
+    }
+    if(tools.empty())
+        throw std::runtime_error("No interaction tools configured");
+    return tools;
+}
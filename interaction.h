@@ -0,0 +1,24 @@
+#pragma once
+#include <vector>
+#include <libconfig.h++>
+#include "glm/glm.hpp"
+
+enum class toolType {
+    PUSH,
+    PULL,
+    VORTEX,
+    SPAWN
+};
+
+// a mouse tool that acts on every particle within radius of the cursor while the left button is held
+struct interactionTool {
+    toolType type;
+    float radius;
+    float strength;
+
+    // velocity change of a particle at offset toMouse from the cursor, given the cursor displacement
+    glm::vec2 velocityDelta(const glm::vec2& toMouse, const glm::vec2& mouseDiff) const;
+};
+
+const char* getToolName(toolType type);
+std::vector<interactionTool> parseInteractionTools(const libconfig::Setting& list);
@@ -0,0 +1,204 @@
+#pragma once
+#include <cmath>
+#include <vector>
+
+#ifndef PI
+#define PI 3.14159265359
+#endif
+
+/*
+    SPH smoothing kernels as policy classes. All of them are constructed from
+    the support radius h and are evaluated on the squared distance r2, with
+    0 <= r2 < h^2 guaranteed by the caller:
+        W(r2)           kernel value, used for density
+        gradOverR(r2)   dW/dr divided by r, so that grad W = gradOverR * diff
+        lap(r2)         laplacian, used for viscosity
+    A kernel only has to provide the functions of the roles it is used for.
+
+    The legacy kernels keep the unnormalized coefficients the config constants
+    (K, p0, viscosity) were tuned with. The alternative kernels are scaled to
+    the same peak values at the same h so those constants stay usable.
+*/
+
+// legacy density kernel
+struct poly6 {
+    float h2 = 0, coeff = 0;
+
+    constexpr poly6() = default;
+    constexpr explicit poly6(float h) : h2(h * h), coeff(315.0f / (64.0f * PI)) { }
+
+    float W(float r2) const {
+        const float d = h2 - r2;
+        return coeff * d * d * d;
+    }
+};
+
+// legacy pressure kernel
+struct spiky {
+    float h = 0, coeff = 0;
+
+    constexpr spiky() = default;
+    constexpr explicit spiky(float h) : h(h), coeff(-45.0f / PI) { }
+
+    float gradOverR(float r2) const {
+        const float r = std::sqrt(r2);
+        return coeff * (h - r) * (h - r) / r;
+    }
+};
+
+// legacy viscosity kernel
+struct viscosityLaplacian {
+    float h = 0, coeff = 0;
+
+    constexpr viscosityLaplacian() = default;
+    constexpr explicit viscosityLaplacian(float h) : h(h), coeff(45.0f / PI) { }
+
+    float lap(float r2) const {
+        return coeff * (h - std::sqrt(r2));
+    }
+};
+
+/*
+    Kernels built from a shape function f(q), q = r / h, with f(0) = 1.
+    Shape provides f, dfOverQ = f'(q) / q, the maximum of |f'| and the limit
+    of f'(q) / q at 0. The laplacian uses the Morris approximation, which is
+    proportional to gradOverR and stays positive over the support.
+*/
+template<class Shape>
+struct shapeKernel {
+    float invH = 0, wPeak = 0, gradCoeff = 0, lapCoeff = 0;
+
+    constexpr shapeKernel() = default;
+    constexpr explicit shapeKernel(float h)
+        : invH(1.0f / h),
+          wPeak(315.0f / (64.0f * PI) * h * h * h * h * h * h),
+          gradCoeff(45.0f / PI * h * h / Shape::dfMax / h),
+          lapCoeff(45.0f / PI * h / Shape::dfOverQ0) { }
+
+    float W(float r2) const {
+        return wPeak * Shape::f(std::sqrt(r2) * invH);
+    }
+
+    float gradOverR(float r2) const {
+        return gradCoeff * Shape::dfOverQ(std::sqrt(r2) * invH);
+    }
+
+    float lap(float r2) const {
+        return lapCoeff * Shape::dfOverQ(std::sqrt(r2) * invH);
+    }
+};
+
+struct cubicSplineShape {
+    static constexpr float dfMax = 2.0f;
+    static constexpr float dfOverQ0 = -12.0f;
+
+    static float f(float q) {
+        if(q <= 0.5f)
+            return 1.0f - 6.0f * q * q + 6.0f * q * q * q;
+        const float d = 1.0f - q;
+        return 2.0f * d * d * d;
+    }
+
+    static float dfOverQ(float q) {
+        if(q <= 0.5f)
+            return -12.0f + 18.0f * q;
+        const float d = 1.0f - q;
+        return -6.0f * d * d / q;
+    }
+};
+
+struct wendlandC2Shape {
+    static constexpr float dfMax = 20.0f * 27.0f / 256.0f;
+    static constexpr float dfOverQ0 = -20.0f;
+
+    static float f(float q) {
+        const float d = 1.0f - q;
+        return d * d * d * d * (1.0f + 4.0f * q);
+    }
+
+    static float dfOverQ(float q) {
+        const float d = 1.0f - q;
+        return -20.0f * d * d * d;
+    }
+};
+
+typedef shapeKernel<cubicSplineShape> cubicSpline;
+typedef shapeKernel<wendlandC2Shape> wendlandC2;
+
+/*
+    Wraps a kernel with lookup tables sampled uniformly in r2 over [0, h^2],
+    so evaluation is a multiply and a linear interpolation without sqrt.
+    Only the functions the wrapped kernel provides are tabulated.
+*/
+template<class K, int N = 1024>
+struct tabulated {
+    float h2 = 0, invStep = 0;
+    std::vector<float> wTable, gradTable, lapTable;
+
+    tabulated() = default;
+    explicit tabulated(float h) : h2(h * h), invStep(N / (h * h)) {
+        const K k(h);
+        fill(wTable, [&](float r2) { return evalW(k, r2, 0); });
+        fill(gradTable, [&](float r2) { return evalGrad(k, r2, 0); });
+        fill(lapTable, [&](float r2) { return evalLap(k, r2, 0); });
+    }
+
+    float W(float r2) const { return lookup(wTable, r2); }
+    float gradOverR(float r2) const { return lookup(gradTable, r2); }
+    float lap(float r2) const { return lookup(lapTable, r2); }
+
+private:
+    template<class F>
+    void fill(std::vector<float>& table, F eval) {
+        table.resize(N + 2);
+        // gradOverR of some kernels diverges at 0, so the first sample is taken half a step out
+        table[0] = eval(0.5f * h2 / N);
+        for(int i = 1; i <= N; i++)
+            table[i] = eval(i * h2 / N);
+        table[N + 1] = table[N];
+    }
+
+    float lookup(const std::vector<float>& table, float r2) const {
+        const float x = r2 * invStep;
+        const int i = (int)x;
+        const float t = x - i;
+        return table[i] + t * (table[i + 1] - table[i]);
+    }
+
+    // functions the wrapped kernel does not provide are tabulated as zero
+    template<class T> static auto evalW(const T& k, float r2, int) -> decltype(k.W(r2)) { return k.W(r2); }
+    template<class T> static float evalW(const T&, float, long) { return 0.0f; }
+    template<class T> static auto evalGrad(const T& k, float r2, int) -> decltype(k.gradOverR(r2)) { return k.gradOverR(r2); }
+    template<class T> static float evalGrad(const T&, float, long) { return 0.0f; }
+    template<class T> static auto evalLap(const T& k, float r2, int) -> decltype(k.lap(r2)) { return k.lap(r2); }
+    template<class T> static float evalLap(const T&, float, long) { return 0.0f; }
+};
+
+// kernels used for density, pressure and viscosity respectively
+template<class Density, class Pressure, class Viscosity>
+struct kernelSet {
+    Density density;
+    Pressure pressure;
+    Viscosity viscosity;
+
+    constexpr kernelSet() = default;
+    constexpr explicit kernelSet(float h) : density(h), pressure(h), viscosity(h) { }
+};
+
+/*
+    The kernel set of the solver is chosen at build time, e.g.
+    make KERNELS=wendland KERNEL_TABLES=true
+*/
+#if defined(KERNEL_TABLES)
+#define SPH_KERNEL(k) tabulated<k>
+#else
+#define SPH_KERNEL(k) k
+#endif
+
+#if defined(KERNELS_CUBIC)
+typedef kernelSet<SPH_KERNEL(cubicSpline), SPH_KERNEL(cubicSpline), SPH_KERNEL(cubicSpline)> sphKernels;
+#elif defined(KERNELS_WENDLAND)
+typedef kernelSet<SPH_KERNEL(wendlandC2), SPH_KERNEL(wendlandC2), SPH_KERNEL(wendlandC2)> sphKernels;
+#else
+typedef kernelSet<SPH_KERNEL(poly6), SPH_KERNEL(spiky), SPH_KERNEL(viscosityLaplacian)> sphKernels;
+#endif
@@ -1,6 +1,12 @@
 #define SDL_MAIN_HANDLED
 #include <iostream>
 #include <stdexcept>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <typeinfo>
+#include <csignal>
 #include <SDL2/SDL.h>
 #include <omp.h>
 #include <libconfig.h++>
@@ -9,17 +15,136 @@
 #include "ODE_solvers/implicitEuler.h"
 #include "utils.h"
 #include "fluid_sim.h"
+#include "frontend.h"
+#include "tracer.h"
+#include "frameexport.h"
+#include "trajectory.h"
+#include "inputlog.h"
+#include "particlefeed.h"
+#include "server.h"
 #include "global.h"
 
-const char* argOpts = "mfc";
+const char* argOpts = "mfcn:tpas:e:l:k:io:r:y:db:u:j:";
 const char* generalConfigPath = "config/general.cfg";
 const char* utilsConfigPath = "config/utils.cfg";
+const char* traceOutputPath = "trace.json";
+const char* checkpointPath = "checkpoint.bin";
+
+// frames run before -a tunes the grid, so it is tuned on a flowing scene rather than the initial lattice
+const int autoTuneFrame = 60;
+
+static uint64_t configHash() {
+    const std::string general = readFileContents(generalConfigPath);
+    const std::string utils = readFileContents(utilsConfigPath);
+    return fnv1a(utils.data(), utils.size(), fnv1a(general.data(), general.size()));
+}
+
+/*
+    File the settled initial state is cached in. The key covers everything
+    the state depends on: both configs, the window size, and the kernels and
+    particle layout of this build.
+*/
+static std::string settledCachePath(int width, int height) {
+    const int layout[] = { width, height, (int)sizeof(point), (int)checkpointVersion };
+    const char* kernelSet = typeid(sphKernels).name();
+    uint64_t hash = fnv1a(layout, sizeof(layout), configHash());
+    hash = fnv1a(kernelSet, strlen(kernelSet), hash);
+
+    char path[64];
+    snprintf(path, sizeof(path), "settled_%016llx.bin", (unsigned long long)hash);
+    return path;
+}
+
+// hands the particles of the finished step to the readers of the shared memory feed
+static void publishFrame(particleFeed* feed, const fluid_sim* sim, bool multithread) {
+    int n;
+    const point* particles = sim->getParticles(n);
+    feed->publish(sim->getSubstep(), particles, n, multithread);
+}
+
+static simServer* activeServer = nullptr;
+
+// Ctrl+C stops a server between steps, so it still saves and cleans up its socket
+static void stopServer(int) {
+    if(activeServer)
+        activeServer->stop();
+}
+
+// the window as a viewer of the simulation server at path, which runs the solver
+static int runViewer(const libconfig::Config& cfg, const char* path, int width, int height, bool velColor) {
+    simClient remote;
+    frontend ui;
+    try {
+        remote.connect(path);
+        ui.setRemote(&remote);
+        ui.setup(cfg, nullptr, width, height);
+    } catch(std::exception& e) {
+        std::cout << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    if(velColor)
+        ui.setColorMode(colorMode::VELOCITY);
+    remote.send("subscribe");
+
+    while(ui.isRunning() && remote.isConnected()) {
+        if(ui.checkShouldUpdate()) {
+            ui.input();
+            remote.poll();
+            for(const std::string& reply : remote.takeReplies())
+                if(reply.compare(0, 5, "error") == 0)
+                    std::cout << "Server: " << reply << std::endl;
+            ui.render();
+            ui.finishFrame();
+        }
+    }
+    if(!remote.isConnected())
+        std::cout << "Server closed the connection" << std::endl;
+
+    ui.destroy();
+    std::cout << "Quit program" << std::endl;
+    return 0;
+}
 
 int main(int argc, char** argv) {
     const int width = 512, height = 512;
     bool multithread = getOption(argc, argv, 'm');
     bool frametime = getOption(argc, argv, 'f');
     bool velColor = getOption(argc, argv, 'c');
+    // -n <steps>: run the given number of steps as fast as possible without a window
+    const char* headlessSteps = getOptionArg(argc, argv, 'n');
+    // -u <socket>: run headless as a server taking commands and streaming frames on a Unix domain socket
+    const char* serverPath = getOptionArg(argc, argv, 'u');
+    // -j <socket>: open the window as a viewer of a server started with -u
+    const char* viewerPath = getOptionArg(argc, argv, 'j');
+    bool headless = headlessSteps != nullptr || serverPath != nullptr;
+    // -t: record per-thread phase timelines, written on exit or with the T key
+    tracer::enabled = getOption(argc, argv, 't');
+    // -p: hardware counters per phase, reported with the phase times
+    bool perfCounters = getOption(argc, argv, 'p');
+    // -a: choose the grid cell size and stencil radius with the fastest density and acceleration passes
+    bool autoTune = getOption(argc, argv, 'a');
+    // -s <file>: write neighbourhood statistics of the final state as CSV
+    const char* statsPath = getOptionArg(argc, argv, 's');
+    // -e <target>: export every frame to target, see export_format in config/general.cfg
+    const char* exportTarget = getOptionArg(argc, argv, 'e');
+    // -l <file>: start from a checkpoint instead of the initial block of particles
+    const char* loadPath = getOptionArg(argc, argv, 'l');
+    // -k <file>: where the S key saves checkpoints, also saved on exit when given
+    const char* savePath = getOptionArg(argc, argv, 'k');
+    if(savePath)
+        checkpointPath = savePath;
+    // -i: start from a settled initial state, cached on disk per config and window size
+    bool settledCache = getOption(argc, argv, 'i');
+    // -o <file>: record particle trajectories, see trajectory_stride in config/general.cfg
+    const char* trajectoryPath = getOptionArg(argc, argv, 'o');
+    // -r <file>: record mouse and tool input with the substep it happened at
+    const char* recordPath = getOptionArg(argc, argv, 'r');
+    // -y <file>: replay a recorded session instead of taking input, with -n 0 headless until it ends
+    const char* replayPath = getOptionArg(argc, argv, 'y');
+    // -d: sum over neighbours in a canonical order, so results do not depend on the thread count or hashing
+    bool deterministic = getOption(argc, argv, 'd');
+    // -b <name>: publish every step to a shared memory ring buffer, see tools/feedreader.cpp
+    const char* feedName = getOptionArg(argc, argv, 'b');
 
     if(multithread)
         std::cout << "Multithreading enabled\nNo. of parallel threads: " << omp_get_max_threads() << std::endl;
@@ -33,6 +158,9 @@ int main(int argc, char** argv) {
         return EXIT_FAILURE;
     }
 
+    if(viewerPath)
+        return runViewer(cfg, viewerPath, width, height, velColor);
+
     glm::vec2 G;
     G.x = cfg.lookup("gravity.x");
     G.y = cfg.lookup("gravity.y");
@@ -42,23 +170,155 @@ int main(int argc, char** argv) {
     });
 
     fluid_sim* sim = new fluid_sim();
+    frontend ui;
+    frameExporter* exporter = nullptr;
+    trajectoryWriter* trajectory = nullptr;
+    particleFeed* feed = nullptr;
+    inputRecorder recorder;
+    inputReplay replay;
     try {
-        sim->setup(cfg, width, height, (ODESolver*)&_integrator);
-        utConf::readConfig();
+        sim->setup(cfg, utConf::cfg, generalConfigPath, width, height, (ODESolver*)&_integrator);
+        ui.setup(cfg, sim, width, height, headless);
+        if(exportTarget) {
+            const char* format = cfg.lookup("export_format");
+            const char* policy = cfg.lookup("export_policy");
+            exporter = new frameExporter(exportTarget, parseExportFormat(format), parseExportPolicy(policy), width, height, cfg.lookup("export_queue_size"));
+            if(!exporter->start())
+                throw std::runtime_error(std::string("Cannot open export target ") + exportTarget);
+        }
+        if(trajectoryPath) {
+            const int cellSize = cfg.lookup("cell_size");
+            const float velQuantum = cfg.lookup("trajectory_velocity_quantum");
+            trajectory = new trajectoryWriter(trajectoryPath, width, height, cellSize, velQuantum, cfg.lookup("trajectory_stride"),
+                cfg.lookup("trajectory_keyframe_interval"), cfg.lookup("trajectory_queue_size"));
+            if(!trajectory->start())
+                throw std::runtime_error(std::string("Cannot create trajectory ") + trajectoryPath);
+        }
+        if(feedName) {
+            feed = new particleFeed(feedName, width, height, cfg.lookup("max_particles"), cfg.lookup("feed_slots"));
+            if(!feed->create())
+                throw std::runtime_error("Cannot create shared memory feed " + feed->getName());
+            std::cout << "Publishing particles to shared memory " << feed->getName() << std::endl;
+        }
+        if(replayPath) {
+            replay.open(replayPath);
+            // the recorded seed makes the generated particles match the session
+            sim->setSeed(replay.getSeed());
+            sim->setInputReplay(&replay);
+            if(replay.getConfigHash() != configHash())
+                std::cout << "Warning: " << replayPath << " was recorded with different configs, the replay will diverge" << std::endl;
+        } else if(recordPath) {
+            if(!recorder.open(recordPath, sim->getSeed(), configHash()))
+                throw std::runtime_error(std::string("Cannot create input log ") + recordPath);
+            sim->setInputRecorder(&recorder);
+        }
     } catch(std::exception& e) {
         std::cout << e.what() << std::endl;
         return EXIT_FAILURE;
     }
 
     sim->setShowFrameTime(frametime);
-    sim->generateInitialParticles();
+    sim->setDeterministic(deterministic);
+    if(velColor)
+        ui.setColorMode(colorMode::VELOCITY);
+    if(perfCounters && !sim->enablePerfCounters())
+        std::cout << "Hardware counters unavailable, reporting phase times only" << std::endl;
+    if(loadPath) {
+        auto start = std::chrono::steady_clock::now();
+        try {
+            sim->loadCheckpoint(loadPath);
+        } catch(std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Loaded " << sim->getParticleCount() << " particles from " << loadPath << " in " << elapsed.count() << " ms" << std::endl;
+    } else if(settledCache) {
+        const std::string cachePath = settledCachePath(width, height);
+        bool cached = false;
+        try {
+            sim->loadCheckpoint(cachePath.c_str());
+            cached = true;
+            std::cout << "Loaded settled state from " << cachePath << std::endl;
+        } catch(std::exception& e) {
+            std::cout << "No usable settled state (" << e.what() << "), settling" << std::endl;
+        }
+        if(!cached) {
+            sim->generateInitialParticles();
+            try {
+                const int steps = sim->settle(cfg.lookup("settle_steps"), multithread);
+                std::cout << "Settled after " << steps << " steps" << std::endl;
+            } catch(std::exception& e) {
+                std::cout << e.what() << std::endl;
+                return EXIT_FAILURE;
+            }
+            sim->saveCheckpoint(cachePath.c_str());
+        }
+    } else {
+        sim->generateInitialParticles();
+    }
+
+    // recording starts with the initial state, after any settling
+    sim->setTrajectoryWriter(trajectory);
+
+    if(serverPath) {
+        simServer server(sim, serverPath, width, height, multithread);
+        auto start = std::chrono::steady_clock::now();
+        try {
+            server.open();
+            std::cout << "Serving on " << serverPath << std::endl;
+            activeServer = &server;
+            std::signal(SIGINT, stopServer);
+            server.run();
+        } catch(std::exception& e) {
+            std::cout << e.what() << std::endl;
+        }
+        activeServer = nullptr;
+        server.close();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Ran " << server.getSteps() << " steps in " << elapsed.count() << " s, sent " << server.getFramesSent()
+            << " frames, dropped " << server.getFramesDropped() << " for slow clients" << std::endl;
+    } else if(headless) {
+        const int steps = atoi(headlessSteps);
+        int step = 0;
+        auto start = std::chrono::steady_clock::now();
+        try {
+            for(; step < steps || (steps == 0 && replayPath && !replay.finished(sim->getSubstep())); step++) {
+                sim->postInput();
+                if(autoTune && step == autoTuneFrame)
+                    sim->autoTuneGrid(multithread);
+                if(multithread)
+                    sim->updateMultithread();
+                else
+                    sim->update();
+                if(feed)
+                    publishFrame(feed, sim, multithread);
+                if(exporter)
+                    ui.exportFrame(*exporter);
+                ui.finishFrame();
+            }
+        } catch(std::exception& e) {
+            std::cout << e.what() << std::endl;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Ran " << step << " steps in " << elapsed.count() << " s (" << step / elapsed.count() << " steps/s)" << std::endl;
+        if(deterministic) {
+            char hash[17];
+            snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)sim->stateHash());
+            std::cout << "State hash " << hash << std::endl;
+        }
+    }
 
-    while(sim->isRunning()) {
-        if(sim->checkShouldUpdate()) {
-            sim->input();
+    int frame = 0;
+    bool replayEnded = false;
+    while(!headless && ui.isRunning()) {
+        if(ui.checkShouldUpdate()) {
+            ui.input();
             sim->postInput();
 
             try {
+                if(autoTune && frame++ == autoTuneFrame)
+                    sim->autoTuneGrid(multithread);
                 if(multithread)
                     sim->updateMultithread();
                 else
@@ -67,14 +327,68 @@ int main(int argc, char** argv) {
                 std::cout << e.what() << std::endl;
                 break;
             }
+            if(feed)
+                publishFrame(feed, sim, multithread);
 
-            sim->render();
+            ui.render();
+            if(exporter)
+                ui.exportFrame(*exporter);
+            ui.finishFrame();
+
+            if(replayPath && !replayEnded && replay.finished(sim->getSubstep())) {
+                replayEnded = true;
+                std::cout << "Replay finished at substep " << sim->getSubstep() << std::endl;
+            }
         }
     }
 
+    if(statsPath) {
+        const neighbourStats stats = sim->collectNeighbourStats();
+        stats.print(std::cout);
+        if(stats.exportCsv(statsPath))
+            std::cout << "Neighbourhood statistics written to " << statsPath << std::endl;
+        else
+            std::cout << "Cannot write " << statsPath << std::endl;
+    }
+
+    if(savePath)
+        sim->saveCheckpoint(savePath);
+
+    if(recordPath && !replayPath) {
+        recorder.close(sim->getSubstep());
+        std::cout << "Input recorded to " << recordPath << std::endl;
+    }
+
+    if(exporter) {
+        exporter->finish();
+        std::cout << "Exported " << exporter->getWritten() << " frames, dropped " << exporter->getDropped() << std::endl;
+        if(exporter->hasFailed())
+            std::cout << "Writing frames to " << exportTarget << " failed" << std::endl;
+        delete exporter;
+    }
+
+    if(trajectory) {
+        trajectory->finish();
+        std::cout << "Recorded " << trajectory->getWritten() << " trajectory frames, " << trajectory->getBytes() << " bytes ("
+            << trajectory->getBytesPerParticle() << " bytes per particle and frame)" << std::endl;
+        if(trajectory->hasFailed())
+            std::cout << "Writing the trajectory to " << trajectoryPath << " failed" << std::endl;
+        delete trajectory;
+    }
+
+    if(feed) {
+        feed->close();
+        std::cout << "Published " << feed->getPublished() << " frames to " << feed->getName() << std::endl;
+        delete feed;
+    }
+
+    ui.destroy();
     sim->destroy();
     delete sim;
 
+    if(tracer::enabled && tracer::dump(traceOutputPath))
+        std::cout << "Trace written to " << traceOutputPath << std::endl;
+
     std::cout << "Quit program" << std::endl;
 
     return 0;
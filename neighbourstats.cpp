@@ -0,0 +1,67 @@
+#include <fstream>
+#include <iomanip>
+#include "neighbourstats.h"
+
+void histogram::add(int v) {
+    if(v >= (int)counts.size())
+        counts.resize(v + 1, 0);
+    counts[v]++;
+    samples++;
+    sum += v;
+}
+
+double histogram::mean() const {
+    return samples > 0 ? (double)sum / samples : 0.0;
+}
+
+int histogram::percentile(double q) const {
+    const long target = (long)(q * samples);
+    long seen = 0;
+    for(int v = 0; v < (int)counts.size(); v++) {
+        seen += counts[v];
+        if(seen > target)
+            return v;
+    }
+    return max();
+}
+
+int histogram::max() const {
+    return (int)counts.size() - 1;
+}
+
+double neighbourStats::acceptance() const {
+    return candidatesPerParticle.sum > 0 ? (double)neighboursPerParticle.sum / candidatesPerParticle.sum : 0.0;
+}
+
+void neighbourStats::print(std::ostream& os) const {
+    const std::ios::fmtflags flags = os.flags();
+    const std::streamsize precision = os.precision();
+    os << "cell size " << cellSize << ", stencil radius " << stencilRadius << " (mean/p50/p99/max)\n";
+    os << std::fixed << std::setprecision(2);
+    const char* names[] = { "particles per cell", "candidates", "neighbours" };
+    const histogram* hists[] = { &particlesPerCell, &candidatesPerParticle, &neighboursPerParticle };
+    for(int i = 0; i < 3; i++) {
+        os << "  " << std::setw(20) << std::left << names[i] << std::right
+           << std::setw(9) << hists[i]->mean() << std::setw(6) << hists[i]->percentile(0.5)
+           << std::setw(6) << hists[i]->percentile(0.99) << std::setw(6) << hists[i]->max() << "\n";
+    }
+    os << "  " << std::setw(20) << std::left << "accepted" << std::right << std::setw(8) << 100.0 * acceptance() << "%\n";
+    os.flags(flags);
+    os.precision(precision);
+    os << std::flush;
+}
+
+bool neighbourStats::exportCsv(const char* path) const {
+    std::ofstream out(path);
+    if(!out)
+        return false;
+    out << "# cell_size=" << cellSize << " stencil_radius=" << stencilRadius << "\n";
+    out << "histogram,value,count\n";
+    const char* names[] = { "particles_per_cell", "candidates_per_particle", "neighbours_per_particle" };
+    const histogram* hists[] = { &particlesPerCell, &candidatesPerParticle, &neighboursPerParticle };
+    for(int i = 0; i < 3; i++)
+        for(int v = 0; v < (int)hists[i]->counts.size(); v++)
+            if(hists[i]->counts[v] > 0)
+                out << names[i] << "," << v << "," << hists[i]->counts[v] << "\n";
+    return (bool)out;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <vector>
+#include <ostream>
+
+// counts of non-negative integer samples, counts[v] is the number of samples equal to v
+struct histogram {
+    std::vector<long> counts;
+    long samples = 0;
+    long sum = 0;
+
+    void add(int v);
+    double mean() const;
+    int percentile(double q) const;
+    int max() const;
+};
+
+/*
+    Neighbourhood statistics of the current particle distribution for a grid
+    layout: particles per interior cell, candidates per particle (particles in
+    the cells of its stencil, itself included) and accepted neighbours per
+    particle (candidates within h).
+*/
+struct neighbourStats {
+    int cellSize;
+    int stencilRadius;
+    histogram particlesPerCell;
+    histogram candidatesPerParticle;
+    histogram neighboursPerParticle;
+
+    // fraction of the candidates that are within h
+    double acceptance() const;
+    void print(std::ostream& os) const;
+    // one row per histogram bin: histogram,value,count
+    bool exportCsv(const char* path) const;
+};
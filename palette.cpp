@@ -0,0 +1,34 @@
+#include <cmath>
+#include "palette.h"
+
+static Uint32 blend(Uint32 from, Uint32 to, float t) {
+    Uint32 color = 0;
+    for(int shift = 0; shift < 32; shift += 8) {
+        const float a = (from >> shift) & 0xFF, b = (to >> shift) & 0xFF;
+        color |= (Uint32)(a + (b - a) * t + 0.5f) << shift;
+    }
+    return color;
+}
+
+palette palette::gradient(Uint32 from, Uint32 to) {
+    palette p;
+    for(int i = 0; i < 256; i++)
+        p.lut[i] = blend(from, to, i / 255.0f);
+    return p;
+}
+
+palette palette::sqrtGradient(Uint32 from, Uint32 to) {
+    palette p;
+    for(int i = 0; i < 256; i++)
+        p.lut[i] = blend(from, to, std::sqrt(i / 255.0f));
+    return p;
+}
+
+palette palette::diverging(Uint32 neg, Uint32 mid, Uint32 pos) {
+    palette p;
+    for(int i = 0; i < 256; i++) {
+        const float t = i / 255.0f * 2.0f - 1.0f;
+        p.lut[i] = t < 0 ? blend(mid, neg, -t) : blend(mid, pos, t);
+    }
+    return p;
+}
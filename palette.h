@@ -0,0 +1,29 @@
+#pragma once
+#include <SDL2/SDL.h>
+
+/*
+    256-entry colour lookup table, so mapping a value to a colour is a scale,
+    a clamp and a load. Colours are ARGB8888.
+*/
+class palette {
+private:
+    Uint32 lut[256] = { };
+
+public:
+    // linear blend between two colours
+    static palette gradient(Uint32 from, Uint32 to);
+    // entry i holds the colour at sqrt(i / 255), so indexing with a squared
+    // magnitude gives the colour of the magnitude without a sqrt
+    static palette sqrtGradient(Uint32 from, Uint32 to);
+    // neg at 0, mid at 127.5 and pos at 255, for signed values
+    static palette diverging(Uint32 neg, Uint32 mid, Uint32 pos);
+
+    Uint32 operator[](int i) const {
+        return lut[i < 0 ? 0 : (i > 255 ? 255 : i)];
+    }
+
+    // t in [0, 1], clamped
+    Uint32 lookup(float t) const {
+        return (*this)[(int)(t * 255.0f)];
+    }
+};
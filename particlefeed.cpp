@@ -0,0 +1,180 @@
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include "particlefeed.h"
+#include "utils.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+std::string particleFeedName(const char* name) {
+    return name[0] == '/' ? name : std::string("/") + name;
+}
+
+// slots start on cache lines, so writing one slot does not disturb readers of the previous one
+static uint64_t alignLine(uint64_t size) {
+    return (size + 63) / 64 * 64;
+}
+
+particleFeed::particleFeed(const char* name, int width, int height, int capacity, int slotCount)
+    : name(particleFeedName(name)), width(width), height(height), capacity(capacity), slotCount(std::max(slotCount, 2)) {
+    slotSize = alignLine(sizeof(particleFeedSlot) + 4 * sizeof(float) * capacity);
+    size = alignLine(sizeof(particleFeedHeader)) + slotSize * this->slotCount;
+}
+
+particleFeed::~particleFeed() {
+    close();
+}
+
+static particleFeedSlot* slotOf(const particleFeedHeader* header, uint64_t frame) {
+    char* slots = (char*)header + alignLine(sizeof(particleFeedHeader));
+    return (particleFeedSlot*)(slots + frame % header->slotCount * header->slotSize);
+}
+
+#ifdef _WIN32
+bool particleFeed::create() {
+    return false;
+}
+
+void particleFeed::close() { }
+
+particleFeedReader::~particleFeedReader() { }
+
+void particleFeedReader::open(const char* name) {
+    throw std::runtime_error("Shared memory feeds are not supported on this platform");
+}
+#else
+bool particleFeed::create() {
+    // readers still mapping a feed of the same name keep the old object
+    shm_unlink(name.c_str());
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if(fd < 0)
+        return false;
+    void* mapping = MAP_FAILED;
+    if(ftruncate(fd, size) == 0)
+        mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(mapping == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    // the object is zero filled, so no slot sequence matches a frame before it is written
+    header = (particleFeedHeader*)mapping;
+    memcpy(header->magic, particleFeedMagic, sizeof(header->magic));
+    header->version = particleFeedVersion;
+    header->slotCount = slotCount;
+    header->slotSize = slotSize;
+    header->capacity = capacity;
+    header->width = width;
+    header->height = height;
+    header->closed.store(0);
+    header->latest.store(0, std::memory_order_release);
+    return true;
+}
+
+void particleFeed::close() {
+    if(!header)
+        return;
+    header->closed.store(1, std::memory_order_release);
+    munmap(header, size);
+    shm_unlink(name.c_str());
+    header = nullptr;
+}
+
+particleFeedReader::~particleFeedReader() {
+    if(header)
+        munmap((void*)header, size);
+}
+
+void particleFeedReader::open(const char* name) {
+    const std::string path = particleFeedName(name);
+    const int fd = shm_open(path.c_str(), O_RDONLY, 0);
+    if(fd < 0)
+        throw std::runtime_error("No particle feed " + path);
+    struct stat st;
+    void* mapping = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(particleFeedHeader))
+        mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(mapping == MAP_FAILED)
+        throw std::runtime_error("Cannot map particle feed " + path);
+
+    header = (const particleFeedHeader*)mapping;
+    size = st.st_size;
+    if(memcmp(header->magic, particleFeedMagic, sizeof(header->magic)) != 0 || header->version != particleFeedVersion)
+        throw std::runtime_error(path + " is not a particle feed of this version");
+    // readers index slots and the particles in them from these fields, so they have to describe the mapping
+    if(header->slotCount == 0 || header->slotSize < sizeof(particleFeedSlot) + 4 * sizeof(float) * (uint64_t)header->capacity)
+        throw std::runtime_error(path + " has an invalid slot layout");
+    if(alignLine(sizeof(particleFeedHeader)) > size || header->slotCount > (size - alignLine(sizeof(particleFeedHeader))) / header->slotSize)
+        throw std::runtime_error(path + " is truncated");
+}
+#endif
+
+/*
+    Seqlock write of one slot: the odd sequence and the release fence make
+    readers that overlap the copy see a changed sequence when they validate.
+*/
+void particleFeed::publish(long step, const point* particles, int count, bool multithread) {
+    if(!header)
+        return;
+    count = std::min<int>(count, capacity);
+    particleFeedSlot* slot = slotOf(header, frame);
+    slot->sequence.store(2 * frame + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->step = step;
+    slot->particleCount = count;
+    float* data = (float*)(slot + 1);
+    #pragma omp parallel for if(multithread)
+    for(int i = 0; i < count; i++) {
+        data[4 * i] = particles[i].pos.x;
+        data[4 * i + 1] = particles[i].pos.y;
+        data[4 * i + 2] = particles[i].vel.x;
+        data[4 * i + 3] = particles[i].vel.y;
+    }
+
+    slot->sequence.store(2 * frame + 2, std::memory_order_release);
+    frame++;
+    header->latest.store(frame, std::memory_order_release);
+}
+
+const std::string& particleFeed::getName() const {
+    return name;
+}
+
+uint64_t particleFeed::getPublished() const {
+    return frame;
+}
+
+const particleFeedHeader& particleFeedReader::getHeader() const {
+    return *header;
+}
+
+bool particleFeedReader::isClosed() const {
+    return header->closed.load(std::memory_order_acquire) != 0;
+}
+
+uint64_t particleFeedReader::getLatest() const {
+    return header->latest.load(std::memory_order_acquire);
+}
+
+const particleFeedSlot* particleFeedReader::acquire(uint64_t frame) const {
+    const particleFeedSlot* slot = slotOf(header, frame);
+    if(slot->sequence.load(std::memory_order_acquire) != 2 * frame + 2)
+        return nullptr;
+    return slot;
+}
+
+const float* particleFeedReader::getParticles(const particleFeedSlot* slot) const {
+    return (const float*)(slot + 1);
+}
+
+bool particleFeedReader::validate(const particleFeedSlot* slot, uint64_t frame) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot->sequence.load(std::memory_order_relaxed) == 2 * frame + 2;
+}
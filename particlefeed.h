@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct point;
+
+/*
+    Shared memory object, native byte order:
+        particleFeedHeader
+        slots       slotCount slots of slotSize bytes, each a particleFeedSlot
+                    followed by room for capacity particles as x, y, vx, vy
+    Frame n is written to slot n % slotCount. The sequence of a slot is odd
+    while the writer fills it and 2 * n + 2 once frame n is complete, after
+    which latest is set to n + 1. Readers map the object read-only and use
+    the particles in place: they take latest, check the sequence of its slot,
+    read the particles and check the sequence again. If it changed the writer
+    lapped them and the frame has to be dropped. The writer never waits for
+    readers.
+*/
+struct particleFeedHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t slotCount;
+    uint64_t slotSize;
+    uint32_t capacity;
+    int32_t width, height;
+    std::atomic<uint32_t> closed;
+    // number of complete frames, the newest is frame latest - 1
+    std::atomic<uint64_t> latest;
+};
+
+struct particleFeedSlot {
+    std::atomic<uint64_t> sequence;
+    int64_t step;
+    uint32_t particleCount;
+    uint32_t reserved;
+};
+
+const char particleFeedMagic[8] = { 'F', 'S', 'I', 'M', 'F', 'E', 'E', 'D' };
+const uint32_t particleFeedVersion = 1;
+
+// readers in other processes only see consistent values if the atomics do not fall back to locks
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+    "the particle feed needs lock-free atomics");
+
+// publishes snapshots of the particles to a POSIX shared memory object, see particleFeedHeader
+class particleFeed {
+private:
+    std::string name;
+    int width, height;
+    uint32_t capacity;
+    uint32_t slotCount;
+    uint64_t slotSize;
+    size_t size;
+    particleFeedHeader* header = nullptr;
+    uint64_t frame = 0;
+
+public:
+    particleFeed(const char* name, int width, int height, int capacity, int slotCount);
+    ~particleFeed();
+
+    // creates and maps the shared memory object, returns false if that fails or is not supported
+    bool create();
+    // writes the particles as frame number getPublished(), at most capacity of them
+    void publish(long step, const point* particles, int count, bool multithread);
+    // marks the feed closed for readers and removes the name, mappings of readers stay valid
+    void close();
+
+    const std::string& getName() const;
+    uint64_t getPublished() const;
+};
+
+// read-only view of a particle feed, throws std::runtime_error if it cannot be mapped
+class particleFeedReader {
+private:
+    const particleFeedHeader* header = nullptr;
+    size_t size = 0;
+
+public:
+    particleFeedReader() = default;
+    particleFeedReader(const particleFeedReader&) = delete;
+    particleFeedReader& operator=(const particleFeedReader&) = delete;
+    ~particleFeedReader();
+
+    void open(const char* name);
+
+    const particleFeedHeader& getHeader() const;
+    bool isClosed() const;
+    // number of complete frames published so far
+    uint64_t getLatest() const;
+    // slot of frame, nullptr if the frame is not complete or already overwritten
+    const particleFeedSlot* acquire(uint64_t frame) const;
+    // x, y, vx, vy per particle of the slot
+    const float* getParticles(const particleFeedSlot* slot) const;
+    // whether the data of frame read from slot since acquire() is still intact
+    bool validate(const particleFeedSlot* slot, uint64_t frame) const;
+};
+
+// shared memory names start with a slash, one is added if name lacks it
+std::string particleFeedName(const char* name);
@@ -0,0 +1,141 @@
+#include <omp.h>
+#include "perfcounters.h"
+
+#ifdef __linux__
+#include <cstring>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static int openCounter(int c) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    switch(c) {
+    case perfCounters::CYCLES:
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case perfCounters::INSTRUCTIONS:
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case perfCounters::L1D_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    case perfCounters::LLC_MISSES:
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    case perfCounters::BRANCH_MISSES:
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    default:
+        return -1;
+    }
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // the calling thread, on any cpu
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void closeCounter(int fd) {
+    ::close(fd);
+}
+
+static uint64_t readCounter(int fd) {
+    uint64_t value = 0;
+    if(::read(fd, &value, sizeof(value)) != sizeof(value))
+        return 0;
+    return value;
+}
+#else
+static int openCounter(int c) {
+    return -1;
+}
+
+static void closeCounter(int fd) { }
+
+static uint64_t readCounter(int fd) {
+    return 0;
+}
+#endif
+
+const char* perfCounters::getCounterName(int c) {
+    switch(c) {
+    case CYCLES:
+        return "cycles";
+    case INSTRUCTIONS:
+        return "instructions";
+    case L1D_MISSES:
+        return "L1D misses";
+    case LLC_MISSES:
+        return "LLC misses";
+    case BRANCH_MISSES:
+        return "branch misses";
+    default:
+        return "unknown";
+    }
+}
+
+perfCounters::~perfCounters() {
+    close();
+}
+
+bool perfCounters::open() {
+    close();
+    const int threads = omp_get_max_threads();
+    fds.assign(threads * COUNT, -1);
+
+    // the same team size reuses the same threads for the solver's parallel regions
+    #pragma omp parallel num_threads(threads)
+    {
+        const int t = omp_get_thread_num();
+        for(int c = 0; c < COUNT; c++)
+            fds[t * COUNT + c] = openCounter(c);
+    }
+
+    // a counter is only reported if it could be opened on every thread
+    bool any = false;
+    for(int c = 0; c < COUNT; c++) {
+        available[c] = true;
+        for(int t = 0; t < threads; t++)
+            available[c] = available[c] && fds[t * COUNT + c] >= 0;
+        any = any || available[c];
+    }
+    if(!any)
+        close();
+    return any;
+}
+
+void perfCounters::close() {
+    for(int fd : fds)
+        if(fd >= 0)
+            closeCounter(fd);
+    fds.clear();
+    for(int c = 0; c < COUNT; c++)
+        available[c] = false;
+}
+
+bool perfCounters::isOpen() const {
+    return !fds.empty();
+}
+
+bool perfCounters::isAvailable(int c) const {
+    return available[c];
+}
+
+void perfCounters::read(uint64_t values[COUNT], bool allThreads) const {
+    for(int c = 0; c < COUNT; c++)
+        values[c] = 0;
+    if(!allThreads) {
+        // outside a parallel region this is the thread that opened the counters of team thread 0
+        const size_t t = omp_get_thread_num();
+        for(int c = 0; c < COUNT; c++)
+            if(available[c] && (t + 1) * COUNT <= fds.size())
+                values[c] = readCounter(fds[t * COUNT + c]);
+        return;
+    }
+    for(size_t i = 0; i < fds.size(); i++)
+        if(available[i % COUNT])
+            values[i % COUNT] += readCounter(fds[i]);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+/*
+    Hardware counters read through perf_event_open. Counters are opened once
+    on every OpenMP thread and always read from the calling thread. A phase
+    that runs in a parallel region reads the sum over all threads so it is
+    counted in full, a serial phase only the counters of the calling thread,
+    since idle workers spinning in the runtime would add to it otherwise.
+    Counters the kernel or the CPU does not provide are left out; on other
+    platforms none are available.
+*/
+class perfCounters {
+public:
+    enum counter {
+        CYCLES,
+        INSTRUCTIONS,
+        L1D_MISSES,
+        LLC_MISSES,
+        BRANCH_MISSES,
+        COUNT
+    };
+
+    static const char* getCounterName(int c);
+
+    perfCounters() = default;
+    perfCounters(const perfCounters&) = delete;
+    perfCounters& operator=(const perfCounters&) = delete;
+    ~perfCounters();
+
+    // returns false if no counter could be opened
+    bool open();
+    void close();
+
+    bool isOpen() const;
+    bool isAvailable(int c) const;
+    // the counters of every thread if allThreads, otherwise those of the calling thread
+    void read(uint64_t values[COUNT], bool allThreads) const;
+
+private:
+    // fds[thread * COUNT + counter], -1 where unavailable
+    std::vector<int> fds;
+    bool available[COUNT] = { };
+};
@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <iomanip>
+#include "profiler.h"
+
+const char* getPhaseName(phase ph) {
+    switch(ph) {
+    case phase::INPUT:
+        return "input";
+    case phase::DENSITY:
+        return "density";
+    case phase::ACCELERATION:
+        return "acceleration";
+    case phase::INTEGRATION:
+        return "integration";
+    case phase::GRID:
+        return "grid";
+    case phase::RENDER:
+        return "render";
+    default:
+        return "unknown";
+    }
+}
+
+profiler::profiler(int windowSize) : windowSize(windowSize) {
+    for(int i = 0; i < phaseCount; i++) {
+        history[i].assign(windowSize, 0.0);
+        for(int c = 0; c < perfCounters::COUNT; c++)
+            counterHistory[i][c].assign(windowSize, 0);
+    }
+}
+
+bool profiler::isEnabled() const {
+    return enabled;
+}
+
+void profiler::setEnabled(bool state) {
+    enabled = state;
+}
+
+bool profiler::enableCounters() {
+    return counters.open();
+}
+
+bool profiler::hasCounters() const {
+    return counters.isOpen();
+}
+
+void profiler::readCounters(uint64_t values[perfCounters::COUNT], bool allThreads) const {
+    counters.read(values, allThreads);
+}
+
+void profiler::add(phase ph, double ms) {
+    current[(int)ph] += ms;
+}
+
+void profiler::addCounters(phase ph, const uint64_t begin[perfCounters::COUNT], const uint64_t end[perfCounters::COUNT]) {
+    for(int c = 0; c < perfCounters::COUNT; c++)
+        counterCurrent[(int)ph][c] += end[c] - begin[c];
+}
+
+void profiler::endFrame() {
+    if(!enabled)
+        return;
+    for(int i = 0; i < phaseCount; i++) {
+        history[i][frameCount % windowSize] = current[i];
+        current[i] = 0;
+        for(int c = 0; c < perfCounters::COUNT; c++) {
+            counterHistory[i][c][frameCount % windowSize] = counterCurrent[i][c];
+            counterCurrent[i][c] = 0;
+        }
+    }
+    frameCount++;
+}
+
+int profiler::getFrameCount() const {
+    return frameCount;
+}
+
+phaseStats profiler::getStats(phase ph) const {
+    const int n = std::min(frameCount, windowSize);
+    if(n == 0)
+        return { 0, 0, 0 };
+
+    std::vector<double> samples(history[(int)ph].begin(), history[(int)ph].begin() + n);
+    phaseStats stats;
+    stats.min = *std::min_element(samples.begin(), samples.end());
+    double sum = 0;
+    for(double s : samples)
+        sum += s;
+    stats.mean = sum / n;
+    auto p99 = samples.begin() + std::min(n - 1, (int)(0.99 * n));
+    std::nth_element(samples.begin(), p99, samples.end());
+    stats.p99 = *p99;
+    return stats;
+}
+
+double profiler::getCounterMean(phase ph, int c) const {
+    const int n = std::min(frameCount, windowSize);
+    if(n == 0)
+        return 0;
+    double sum = 0;
+    for(int i = 0; i < n; i++)
+        sum += counterHistory[(int)ph][c][i];
+    return sum / n;
+}
+
+void profiler::print(std::ostream& os) const {
+    const std::ios::fmtflags flags = os.flags();
+    const std::streamsize precision = os.precision();
+    os << "frame " << frameCount << " (ms, min/mean/p99 over " << std::min(frameCount, windowSize) << " frames)\n";
+    os << std::fixed << std::setprecision(3);
+    for(int i = 0; i < phaseCount; i++) {
+        const phaseStats s = getStats((phase)i);
+        os << "  " << std::setw(12) << std::left << getPhaseName((phase)i) << std::right
+           << std::setw(9) << s.min << std::setw(9) << s.mean << std::setw(9) << s.p99 << "\n";
+    }
+    if(hasCounters()) {
+        // per-frame means; IPC tells compute-bound phases from ones stalled on memory
+        os << "  counters (mean per frame, k):\n  " << std::setw(12) << "";
+        for(int c = 0; c < perfCounters::COUNT; c++)
+            if(counters.isAvailable(c))
+                os << std::setw(15) << perfCounters::getCounterName(c);
+        if(counters.isAvailable(perfCounters::CYCLES) && counters.isAvailable(perfCounters::INSTRUCTIONS))
+            os << std::setw(7) << "IPC";
+        os << "\n";
+        for(int i = 0; i < phaseCount; i++) {
+            os << "  " << std::setw(12) << std::left << getPhaseName((phase)i) << std::right << std::setprecision(1);
+            for(int c = 0; c < perfCounters::COUNT; c++)
+                if(counters.isAvailable(c))
+                    os << std::setw(15) << getCounterMean((phase)i, c) / 1000.0;
+            if(counters.isAvailable(perfCounters::CYCLES) && counters.isAvailable(perfCounters::INSTRUCTIONS)) {
+                const double cycles = getCounterMean((phase)i, perfCounters::CYCLES);
+                os << std::setw(7) << std::setprecision(2) << (cycles > 0 ? getCounterMean((phase)i, perfCounters::INSTRUCTIONS) / cycles : 0.0);
+            }
+            os << "\n";
+        }
+    }
+    os.flags(flags);
+    os.precision(precision);
+    os << std::flush;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <chrono>
+#include <vector>
+#include <ostream>
+#include "tracer.h"
+#include "perfcounters.h"
+
+enum class phase {
+    INPUT,
+    DENSITY,
+    ACCELERATION,
+    INTEGRATION,
+    GRID,
+    RENDER,
+    COUNT
+};
+
+const char* getPhaseName(phase ph);
+
+struct phaseStats {
+    double min;
+    double mean;
+    double p99;
+};
+
+/*
+    Accumulates the time spent in each phase over a frame and keeps the
+    per-frame totals of the last windowSize frames. Times are in milliseconds.
+    With hardware counters enabled, the counter deltas of each phase are kept
+    the same way and reported as per-frame means next to the times.
+*/
+class profiler {
+private:
+    static const int phaseCount = (int)phase::COUNT;
+
+    bool enabled = false;
+    int windowSize;
+    int frameCount = 0;
+    double current[phaseCount] = { };
+    std::vector<double> history[phaseCount];
+
+    perfCounters counters;
+    uint64_t counterCurrent[phaseCount][perfCounters::COUNT] = { };
+    std::vector<uint64_t> counterHistory[phaseCount][perfCounters::COUNT];
+
+public:
+    profiler(int windowSize = 120);
+
+    bool isEnabled() const;
+    void setEnabled(bool state);
+    // opens the hardware counters, returns false if none are available
+    bool enableCounters();
+    bool hasCounters() const;
+    void readCounters(uint64_t values[perfCounters::COUNT], bool allThreads) const;
+
+    void add(phase ph, double ms);
+    void addCounters(phase ph, const uint64_t begin[perfCounters::COUNT], const uint64_t end[perfCounters::COUNT]);
+    void endFrame();
+    int getFrameCount() const;
+
+    phaseStats getStats(phase ph) const;
+    double getCounterMean(phase ph, int c) const;
+    void print(std::ostream& os) const;
+};
+
+/*
+    Adds the lifetime of the object to a phase of the profiler, and to the
+    trace when tracing. parallel says whether the phase runs OpenMP parallel
+    regions, whose counters are summed over all threads.
+*/
+class phaseTimer {
+private:
+    profiler& prof;
+    phase ph;
+    bool parallel;
+    std::chrono::steady_clock::time_point start;
+    uint64_t startCounters[perfCounters::COUNT];
+    traceScope trace;
+
+public:
+    phaseTimer(profiler& prof, phase ph, bool parallel) : prof(prof), ph(ph), parallel(parallel), trace(getPhaseName(ph)) {
+        if(prof.isEnabled()) {
+            if(prof.hasCounters())
+                prof.readCounters(startCounters, parallel);
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~phaseTimer() {
+        if(prof.isEnabled()) {
+            prof.add(ph, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            if(prof.hasCounters()) {
+                uint64_t endCounters[perfCounters::COUNT];
+                prof.readCounters(endCounters, parallel);
+                prof.addCounters(ph, startCounters, endCounters);
+            }
+        }
+    }
+};
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cstring>
+#include "rans.h"
+
+static const int probBits = 12;
+static const uint32_t probScale = 1 << probBits;
+static const uint32_t ransLow = 1u << 23;
+
+// scales symbol counts to frequencies summing to probScale, keeping every present symbol at least 1
+static void normalize(const uint32_t counts[256], size_t total, uint32_t freqs[256]) {
+    uint32_t sum = 0;
+    for(int s = 0; s < 256; s++) {
+        freqs[s] = counts[s] ? (uint32_t)((uint64_t)counts[s] * probScale / total) : 0;
+        if(counts[s] && freqs[s] == 0)
+            freqs[s] = 1;
+        sum += freqs[s];
+    }
+    // the rounding error goes to the most frequent symbols, which it costs the least
+    while(sum != probScale) {
+        int largest = 0;
+        for(int s = 1; s < 256; s++)
+            if(freqs[s] > freqs[largest])
+                largest = s;
+        if(sum < probScale) {
+            freqs[largest] += probScale - sum;
+            sum = probScale;
+        } else {
+            const uint32_t take = std::min(sum - probScale, freqs[largest] - 1);
+            freqs[largest] -= take;
+            sum -= take;
+        }
+    }
+}
+
+static void put16(std::vector<uint8_t>& out, uint32_t v) {
+    out.push_back(v);
+    out.push_back(v >> 8);
+}
+
+static uint32_t get16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void encodeStored(const uint8_t* data, size_t n, std::vector<uint8_t>& out) {
+    put16(out, storedBlock);
+    put16(out, n);
+    put16(out, n >> 16);
+    out.insert(out.end(), data, data + n);
+}
+
+void ransEncode(const uint8_t* data, size_t n, std::vector<uint8_t>& out) {
+    uint32_t counts[256] = { };
+    for(size_t i = 0; i < n; i++)
+        counts[data[i]]++;
+    uint32_t freqs[256] = { }, starts[256];
+    if(n > 0)
+        normalize(counts, n, freqs);
+    uint32_t start = 0;
+    int symbols = 0;
+    for(int s = 0; s < 256; s++) {
+        starts[s] = start;
+        start += freqs[s];
+        symbols += freqs[s] > 0;
+    }
+
+    // rANS emits bytes in reverse, so the stream is built backwards from the end of a scratch buffer.
+    // Output beyond n bytes no longer pays off, coding stops there and the data is stored instead
+    std::vector<uint8_t> coded(n + 4);
+    uint8_t* ptr = coded.data() + coded.size();
+    uint32_t x = ransLow;
+    for(size_t i = n; i-- > 0;) {
+        const uint32_t freq = freqs[data[i]];
+        const uint32_t xMax = ((ransLow >> probBits) << 8) * freq;
+        while(x >= xMax) {
+            if(ptr == coded.data() + 4) {
+                encodeStored(data, n, out);
+                return;
+            }
+            *--ptr = x & 0xFF;
+            x >>= 8;
+        }
+        x = ((x / freq) << probBits) + (x % freq) + starts[data[i]];
+    }
+    for(int k = 0; k < 4; k++)
+        *--ptr = x >> (8 * k);
+    const uint32_t size = coded.data() + coded.size() - ptr;
+    if(n > 0 && size + 3 * symbols >= n) {
+        encodeStored(data, n, out);
+        return;
+    }
+
+    put16(out, symbols);
+    for(int s = 0; s < 256; s++) {
+        if(freqs[s]) {
+            out.push_back(s);
+            put16(out, freqs[s] == probScale ? 0 : freqs[s]);
+        }
+    }
+
+    put16(out, size);
+    put16(out, size >> 16);
+    out.insert(out.end(), ptr, ptr + size);
+}
+
+size_t ransDecode(const uint8_t* src, size_t srcSize, uint8_t* out, size_t n) {
+    if(srcSize < 2)
+        return 0;
+    const uint8_t* p = src;
+    const uint8_t* end = src + srcSize;
+    const int symbols = get16(p);
+    p += 2;
+    if(symbols == storedBlock) {
+        if(end - p < 4 || get32(p) != n || (size_t)(end - p - 4) < n)
+            return 0;
+        memcpy(out, p + 4, n);
+        return p + 4 + n - src;
+    }
+    if(symbols > 256 || end - p < symbols * 3 + 4)
+        return 0;
+
+    uint32_t freqs[256] = { }, starts[256] = { };
+    uint8_t slotSymbol[probScale];
+    uint32_t start = 0;
+    for(int k = 0; k < symbols; k++) {
+        const uint8_t s = p[0];
+        const uint32_t freq = get16(p + 1) ? get16(p + 1) : probScale;
+        p += 3;
+        if(start + freq > probScale)
+            return 0;
+        freqs[s] = freq;
+        starts[s] = start;
+        memset(slotSymbol + start, s, freq);
+        start += freq;
+    }
+    if(n > 0 && start != probScale)
+        return 0;
+
+    const uint32_t size = get32(p);
+    p += 4;
+    if(size < 4 || (size_t)(end - p) < size)
+        return 0;
+    const uint8_t* ptr = p;
+    const uint8_t* codedEnd = p + size;
+
+    uint32_t x = (ptr[0] << 24) | (ptr[1] << 16) | (ptr[2] << 8) | ptr[3];
+    ptr += 4;
+    for(size_t i = 0; i < n; i++) {
+        const uint8_t s = slotSymbol[x & (probScale - 1)];
+        out[i] = s;
+        x = freqs[s] * (x >> probBits) + (x & (probScale - 1)) - starts[s];
+        while(x < ransLow) {
+            if(ptr == codedEnd)
+                return 0;
+            x = (x << 8) | *ptr++;
+        }
+    }
+    return codedEnd - src;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+    Order-0 rANS entropy coder for byte streams (32-bit state, byte-wise
+    renormalization, 12-bit probabilities). A block stores its own
+    frequency table followed by the coded bytes:
+        uint16 symbol count, then per symbol: uint8 symbol, uint16 frequency
+        uint32 coded size, coded bytes
+    A stream of a single repeated byte codes to the table and the 4-byte state.
+    Data that does not compress, like near uniform bytes, is stored instead:
+        uint16 storedBlock, uint32 size n, the n bytes
+*/
+const uint16_t storedBlock = 0xFFFF;
+
+// appends the block coding data[0..n) to out
+void ransEncode(const uint8_t* data, size_t n, std::vector<uint8_t>& out);
+
+// decodes n bytes from the block at src, returns the size of the block or 0 if it is malformed
+size_t ransDecode(const uint8_t* src, size_t srcSize, uint8_t* out, size_t n);
@@ -0,0 +1,109 @@
+#include <omp.h>
+#include <algorithm>
+#include "rasterizer.h"
+
+rasterizer::rasterizer(int w, int h, int tileSize) : width(w), height(h), tileSize(tileSize) {
+    tilesX = (width + tileSize - 1) / tileSize;
+    tilesY = (height + tileSize - 1) / tileSize;
+    pixels.assign(width * height, 0);
+    bins.resize(omp_get_max_threads() * tilesX * tilesY);
+}
+
+int rasterizer::getWidth() const {
+    return width;
+}
+
+int rasterizer::getHeight() const {
+    return height;
+}
+
+const Uint32* rasterizer::getPixels() const {
+    return pixels.data();
+}
+
+std::vector<glm::ivec2> rasterizer::circleOutline(float radius) {
+    std::vector<glm::ivec2> offsets;
+    const int diameter = radius * 2;
+    int x = radius - 1;
+    int y = 0;
+    int tx = 1;
+    int ty = 1;
+    int error = tx - diameter;
+    while(x >= y) {
+        const glm::ivec2 octant[] = { { x, -y }, { x, y }, { -x, -y }, { -x, y }, { y, -x }, { y, x }, { -y, -x }, { -y, x } };
+        offsets.insert(offsets.end(), octant, octant + 8);
+
+        if(error <= 0) {
+            ++y;
+            error += ty;
+            ty += 2;
+        }
+        if(error > 0) {
+            --x;
+            tx += 2;
+            error += tx - diameter;
+        }
+    }
+    return offsets;
+}
+
+void rasterizer::setCircleRadius(float radius) {
+    if(radius == circleRadius)
+        return;
+    circleRadius = radius;
+    circleOffsets = circleOutline(radius);
+}
+
+void rasterizer::drawCircles(const glm::vec2* centers, const Uint32* colors, int count, float radius, Uint32 background) {
+    setCircleRadius(radius);
+    const int tileCount = tilesX * tilesY;
+    const int extent = (int)radius + 1;
+
+    #pragma omp parallel
+    {
+        // bin every circle into the tiles its bounding box overlaps
+        std::vector<int>* threadBins = &bins[omp_get_thread_num() * tileCount];
+        for(int t = 0; t < tileCount; t++)
+            threadBins[t].clear();
+
+        #pragma omp for schedule(static)
+        for(int i = 0; i < count; i++) {
+            const int cx = centers[i].x, cy = centers[i].y;
+            const int tx0 = std::max(0, (cx - extent) / tileSize), tx1 = std::min(tilesX - 1, (cx + extent) / tileSize);
+            const int ty0 = std::max(0, (cy - extent) / tileSize), ty1 = std::min(tilesY - 1, (cy + extent) / tileSize);
+            for(int ty = ty0; ty <= ty1; ty++)
+                for(int tx = tx0; tx <= tx1; tx++)
+                    threadBins[ty * tilesX + tx].push_back(i);
+        }
+        // implicit barrier: all bins are complete
+
+        const int threads = omp_get_num_threads();
+        #pragma omp for schedule(dynamic)
+        for(int t = 0; t < tileCount; t++) {
+            const int x0 = (t % tilesX) * tileSize, x1 = std::min(width, x0 + tileSize);
+            const int y0 = (t / tilesX) * tileSize, y1 = std::min(height, y0 + tileSize);
+            for(int y = y0; y < y1; y++)
+                std::fill(pixels.begin() + y * width + x0, pixels.begin() + y * width + x1, background);
+
+            // bins are visited in thread order, so circles are drawn in the order they were given
+            for(int b = 0; b < threads; b++) {
+                for(int i : bins[b * tileCount + t]) {
+                    const glm::ivec2 c(centers[i]);
+                    const Uint32 color = colors[i];
+                    if(c.x - extent >= x0 && c.x + extent < x1 && c.y - extent >= y0 && c.y + extent < y1) {
+                        // most circles lie inside a single tile and need no clipping
+                        Uint32* center = &pixels[c.y * width + c.x];
+                        for(const glm::ivec2& o : circleOffsets)
+                            center[o.y * width + o.x] = color;
+                        continue;
+                    }
+                    for(const glm::ivec2& o : circleOffsets) {
+                        const int x = c.x + o.x, y = c.y + o.y;
+                        if(x >= x0 && x < x1 && y >= y0 && y < y1)
+                            pixels[y * width + x] = color;
+                    }
+                }
+            }
+        }
+    }
+}
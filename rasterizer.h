@@ -0,0 +1,40 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <vector>
+#include "glm/glm.hpp"
+
+/*
+    Draws particles into a CPU framebuffer, which the renderer uploads to a
+    streaming texture once per frame. The framebuffer is split into square
+    tiles: shapes are first binned by the tiles they overlap, then every tile
+    is cleared and drawn by a single thread, so threads never write the same
+    pixels and the cost follows the number of pixels touched.
+*/
+class rasterizer {
+private:
+    int width, height;
+    int tileSize;
+    int tilesX, tilesY;
+    std::vector<Uint32> pixels;
+    // bins[thread * tileCount + tile] holds the shapes binned to a tile by a thread,
+    // kept between frames so their storage is reused
+    std::vector<std::vector<int>> bins;
+    // pixel offsets of a circle outline around its center
+    std::vector<glm::ivec2> circleOffsets;
+    float circleRadius = -1;
+
+    void setCircleRadius(float radius);
+
+public:
+    rasterizer(int w, int h, int tileSize = 64);
+
+    // pixel offsets of the midpoint circle outline drawn by renderer::drawCircle
+    static std::vector<glm::ivec2> circleOutline(float radius);
+
+    int getWidth() const;
+    int getHeight() const;
+    const Uint32* getPixels() const;
+
+    // clears the framebuffer to background and draws circle outlines around the given centers
+    void drawCircles(const glm::vec2* centers, const Uint32* colors, int count, float radius, Uint32 background);
+};
@@ -1,7 +1,12 @@
 #include <iostream>
+#include <algorithm>
+#include <omp.h>
 #include "renderer.h"
+#include "rasterizer.h"
 
 renderer::~renderer() {
+    SDL_DestroyTexture(spriteTexture);
+    SDL_DestroyTexture(frameTexture);
     SDL_DestroyRenderer(ren);
     SDL_DestroyWindow(window);
     SDL_Quit();
@@ -41,9 +46,19 @@ bool renderer::setup(int w, int h) {
         return false;
     }
 
+    frameTexture = SDL_CreateTexture(ren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, windowWidth, windowHeight);
+    if(!frameTexture) {
+        std::cerr << "Error initializing framebuffer texture" << std::endl;
+        return false;
+    }
+
     return true;
 }
 
+void renderer::setTitle(const char* title) const {
+    SDL_SetWindowTitle(window, title);
+}
+
 void renderer::clearScreen(Uint32 color) const {
     SDL_SetRenderDrawColor(ren, color >> 16, color >> 8, color, 255);
     SDL_RenderClear(ren);
@@ -53,6 +68,60 @@ void renderer::render() const {
     SDL_RenderPresent(ren);
 }
 
+void renderer::drawFramebuffer(const Uint32* pixels) const {
+    SDL_UpdateTexture(frameTexture, nullptr, pixels, windowWidth * sizeof(Uint32));
+    SDL_RenderCopy(ren, frameTexture, nullptr, nullptr);
+}
+
+bool renderer::createCircleSprite(float radius) {
+    SDL_DestroyTexture(spriteTexture);
+    spriteExtent = radius;
+    const int size = 2 * spriteExtent + 1;
+    std::vector<Uint32> pixels(size * size, 0x00FFFFFF);
+    for(const glm::ivec2& o : rasterizer::circleOutline(radius))
+        pixels[(spriteExtent + o.y) * size + spriteExtent + o.x] = 0xFFFFFFFF;
+
+    spriteTexture = SDL_CreateTexture(ren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, size, size);
+    if(!spriteTexture) {
+        std::cerr << "Error creating particle sprite" << std::endl;
+        return false;
+    }
+    SDL_UpdateTexture(spriteTexture, nullptr, pixels.data(), size * sizeof(Uint32));
+    SDL_SetTextureBlendMode(spriteTexture, SDL_BLENDMODE_BLEND);
+    SDL_SetTextureScaleMode(spriteTexture, SDL_ScaleModeNearest);
+    return true;
+}
+
+void renderer::drawSprites(const glm::vec2* centers, const Uint32* colors, int count) {
+    const float size = 2 * spriteExtent + 1;
+
+    // the index pattern only depends on the count, so it is only extended when the count grows
+    const int oldCount = spriteIndices.size() / 6;
+    if(count > oldCount) {
+        spriteIndices.resize(count * 6);
+        for(int i = oldCount; i < count; i++) {
+            const int quad[] = { 4 * i, 4 * i + 1, 4 * i + 2, 4 * i + 2, 4 * i + 3, 4 * i };
+            std::copy(quad, quad + 6, &spriteIndices[i * 6]);
+        }
+    }
+    spriteVertices.resize(count * 4);
+
+    #pragma omp parallel for
+    for(int i = 0; i < count; i++) {
+        // snapped to the pixel the circle is centered on, as in drawCircle
+        const float x = (int)centers[i].x - spriteExtent, y = (int)centers[i].y - spriteExtent;
+        const Uint32 color = colors[i];
+        const SDL_Color tint = { (Uint8)(color >> 16), (Uint8)(color >> 8), (Uint8)color, (Uint8)(color >> 24) };
+        SDL_Vertex* v = &spriteVertices[i * 4];
+        v[0] = { { x, y }, tint, { 0, 0 } };
+        v[1] = { { x + size, y }, tint, { 1, 0 } };
+        v[2] = { { x + size, y + size }, tint, { 1, 1 } };
+        v[3] = { { x, y + size }, tint, { 0, 1 } };
+    }
+
+    SDL_RenderGeometry(ren, spriteTexture, spriteVertices.data(), count * 4, spriteIndices.data(), count * 6);
+}
+
 void renderer::drawLine(glm::vec2 p0, glm::vec2 p1, Uint32 color) const {
     SDL_SetRenderDrawColor(ren, color >> 16, color >> 8, color, 255);
     SDL_RenderDrawLine(ren, p0.x, p0.y, p1.x, p1.y);
@@ -122,4 +191,10 @@ void renderer::drawSimpleCircle(glm::vec2 center, Uint32 color) const {
         SDL_RenderDrawPoint(ren, center.x - 2, center.y + offset);
         SDL_RenderDrawPoint(ren, center.x + 2, center.y + offset);
     }
+}
+
+void renderer::fillRect(glm::vec2 pos, glm::vec2 size, Uint32 color) const {
+    SDL_SetRenderDrawColor(ren, color >> 16, color >> 8, color, 255);
+    const SDL_Rect rect = { (int)pos.x, (int)pos.y, (int)size.x, (int)size.y };
+    SDL_RenderFillRect(ren, &rect);
 }
\ No newline at end of file
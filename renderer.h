@@ -1,5 +1,6 @@
 #pragma once
 #include <SDL2/SDL.h>
+#include <vector>
 #include "glm/glm.hpp"
 
 class renderer {
@@ -7,6 +8,12 @@ private:
     int windowWidth, windowHeight;
     SDL_Window* window;
     SDL_Renderer* ren;
+    SDL_Texture* frameTexture = nullptr;
+    // white circle outline, tinted per vertex by drawSprites
+    SDL_Texture* spriteTexture = nullptr;
+    int spriteExtent = 0;
+    std::vector<SDL_Vertex> spriteVertices;
+    std::vector<int> spriteIndices;
 
 public:
     renderer() = default;
@@ -17,12 +24,19 @@ public:
 
     bool setup(int w = 0, int h = 0);
 
+    void setTitle(const char* title) const;
     void clearScreen(Uint32 color) const;
     void render() const;
+    // uploads a window-sized ARGB8888 framebuffer and draws it over the whole window
+    void drawFramebuffer(const Uint32* pixels) const;
+    bool createCircleSprite(float radius);
+    // draws the circle sprite at every center with a single SDL_RenderGeometry call
+    void drawSprites(const glm::vec2* centers, const Uint32* colors, int count);
 
     void drawLine(glm::vec2 p0, glm::vec2 p1, Uint32 color) const;
     void drawPoint(glm::vec2 p, Uint32 color) const;
     void drawCircle(glm::vec2 center, float radius, Uint32 color) const;
     void drawFilledCircle(glm::vec2 center, float radius, Uint32 color) const;
     void drawSimpleCircle(glm::vec2 center, Uint32 color) const;
+    void fillRect(glm::vec2 pos, glm::vec2 size, Uint32 color) const;
 };
\ No newline at end of file
@@ -0,0 +1,483 @@
+#include <stdexcept>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include "server.h"
+#include "fluid_sim.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// a client sending a longer line without a newline is disconnected
+const size_t maxCommandLength = 4096;
+// as is one that sends commands without reading the replies, beyond a frame and this many bytes
+const size_t maxPendingReplies = 1 << 20;
+
+simServer::simServer(fluid_sim* sim, const char* path, int width, int height, bool multithread)
+    : sim(sim), path(path), width(width), height(height), multithread(multithread) { }
+
+simServer::~simServer() {
+    close();
+}
+
+void simServer::stop() {
+    stopping = true;
+}
+
+long simServer::getSteps() const {
+    return steps;
+}
+
+long simServer::getFramesSent() const {
+    return framesSent;
+}
+
+long simServer::getFramesDropped() const {
+    return framesDropped;
+}
+
+void simServer::queue(client& c, serverMessageType type, const void* data, size_t size) {
+    const serverMessage header = { type, (uint32_t)size };
+    const char* bytes = (const char*)&header;
+    c.output.insert(c.output.end(), bytes, bytes + sizeof(header));
+    c.output.insert(c.output.end(), (const char*)data, (const char*)data + size);
+}
+
+/*
+    Positions are stored in 1/65535 of the larger side of the domain and
+    velocities in 1/32767 of max_vel, which the solver caps them to.
+*/
+void simServer::encodeFrame() {
+    int n;
+    const point* particles = sim->getParticles(n);
+    serverFrame header;
+    header.step = sim->getSubstep();
+    header.count = n;
+    header.dropped = 0;
+    header.posScale = std::max(width, height) / 65535.0f;
+    header.velScale = sim->getParameter("max_vel") / 32767.0f;
+
+    frame.resize(sizeof(header) + 8 * (size_t)n);
+    memcpy(frame.data(), &header, sizeof(header));
+    int16_t* data = (int16_t*)(frame.data() + sizeof(header));
+    const float posInv = 1.0f / header.posScale, velInv = 1.0f / header.velScale;
+    #pragma omp parallel for if(multithread)
+    for(int i = 0; i < n; i++) {
+        uint16_t* pos = (uint16_t*)&data[4 * i];
+        pos[0] = (uint16_t)std::min(65535.0f, std::max(0.0f, std::round(particles[i].pos.x * posInv)));
+        pos[1] = (uint16_t)std::min(65535.0f, std::max(0.0f, std::round(particles[i].pos.y * posInv)));
+        data[4 * i + 2] = (int16_t)std::min(32767.0f, std::max(-32767.0f, std::round(particles[i].vel.x * velInv)));
+        data[4 * i + 3] = (int16_t)std::min(32767.0f, std::max(-32767.0f, std::round(particles[i].vel.y * velInv)));
+    }
+    frameStep = steps;
+}
+
+void simServer::sendFrame(client& c) {
+    if(frameStep != steps)
+        encodeFrame();
+    const size_t start = c.output.size();
+    queue(c, serverMessageType::FRAME, frame.data(), frame.size());
+    serverFrame* header = (serverFrame*)(c.output.data() + start + sizeof(serverMessage));
+    header->dropped = c.dropped;
+    c.dropped = 0;
+    c.frameEnd = c.output.size();
+    framesSent++;
+}
+
+/*
+    Queues the current frame for the subscribers due this step. A client
+    that has not yet read its previous frame is skipped and counts the frame
+    as dropped, so at most one frame per client is buffered.
+*/
+void simServer::sendFrames() {
+    for(client& c : clients) {
+        if(c.fd < 0 || c.every == 0 || steps % c.every != 0)
+            continue;
+        if(c.sent < c.frameEnd) {
+            c.dropped++;
+            framesDropped++;
+            continue;
+        }
+        sendFrame(c);
+    }
+}
+
+std::string simServer::execute(client& c, const std::string& line) {
+    std::istringstream in(line);
+    std::string command;
+    in >> command;
+    if(command.empty())
+        return "";
+
+    if(command == "step") {
+        long n = 1;
+        in >> n;
+        running = false;
+        pendingSteps += std::max(0L, n);
+        return "ok " + std::to_string(pendingSteps);
+    }
+    if(command == "run") {
+        running = true;
+        return "ok";
+    }
+    if(command == "pause") {
+        running = false;
+        pendingSteps = 0;
+        return "ok";
+    }
+    if(command == "set" || command == "get") {
+        std::string name;
+        float value;
+        if(!(in >> name) || (command == "set" && !(in >> value)))
+            return "error usage: " + command + " <name>" + (command == "set" ? " <value>" : "");
+        try {
+            if(command == "set")
+                sim->setParameter(name, value);
+            return "ok " + std::to_string(sim->getParameter(name));
+        } catch(std::exception& e) {
+            return std::string("error ") + e.what();
+        }
+    }
+    if(command == "spawn") {
+        float x, y, radius;
+        if(!(in >> x >> y >> radius) || !(radius > 0) || !std::isfinite(x) || !std::isfinite(y) || !std::isfinite(radius))
+            return "error usage: spawn <x> <y> <radius>";
+        return "ok " + std::to_string(sim->spawnInCircle({ x, y }, radius, sim->getH()));
+    }
+    if(command == "force") {
+        float x, y, radius, vx, vy;
+        if(!(in >> x >> y >> radius >> vx >> vy) || !(radius > 0) || !std::isfinite(x) || !std::isfinite(y) || !std::isfinite(radius)
+            || !std::isfinite(vx) || !std::isfinite(vy))
+            return "error usage: force <x> <y> <radius> <vx> <vy>";
+        sim->applyImpulse({ x, y }, radius, { vx, vy });
+        return "ok";
+    }
+    if(command == "subscribe") {
+        int every = 1;
+        in >> every;
+        c.every = std::max(1, every);
+        c.dropped = 0;
+        return "ok";
+    }
+    if(command == "unsubscribe") {
+        c.every = 0;
+        return "ok";
+    }
+    if(command == "status") {
+        return "ok step " + std::to_string(sim->getSubstep()) + " particles " + std::to_string(sim->getParticleCount())
+            + (running ? " running" : " paused") + " clients " + std::to_string(clients.size());
+    }
+    if(command == "shutdown") {
+        stopping = true;
+        return "ok";
+    }
+    return "error unknown command " + command;
+}
+
+#ifdef _WIN32
+void simServer::open() {
+    throw std::runtime_error("The simulation server needs Unix domain sockets, which this platform lacks");
+}
+
+void simServer::close() { }
+void simServer::run() { }
+void simServer::accept() { }
+bool simServer::receive(client& c) { return false; }
+bool simServer::flush(client& c) { return false; }
+
+simClient::~simClient() { }
+
+void simClient::connect(const char* path) {
+    throw std::runtime_error("The simulation server needs Unix domain sockets, which this platform lacks");
+}
+
+void simClient::close() { }
+bool simClient::send(const std::string& command) { return false; }
+bool simClient::poll() { return false; }
+#else
+static bool setNonBlocking(int fd) {
+    const int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static bool fillAddress(const std::string& path, sockaddr_un& addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(addr.sun_path))
+        return false;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+void simServer::open() {
+    sockaddr_un addr;
+    if(!fillAddress(path, addr))
+        throw std::runtime_error("Socket path " + path + " is too long");
+    // a socket left behind by a server that did not shut down cleanly is replaced, anything else is not
+    struct stat st;
+    if(lstat(path.c_str(), &st) == 0) {
+        if(!S_ISSOCK(st.st_mode))
+            throw std::runtime_error(path + " exists and is not a socket");
+        unlink(path.c_str());
+    }
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listenFd < 0)
+        throw std::runtime_error("Cannot create socket");
+    if(bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd, 8) != 0 || !setNonBlocking(listenFd)) {
+        ::close(listenFd);
+        listenFd = -1;
+        throw std::runtime_error("Cannot listen on " + path + ": " + strerror(errno));
+    }
+}
+
+void simServer::close() {
+    if(listenFd < 0)
+        return;
+    for(client& c : clients)
+        if(c.fd >= 0)
+            ::close(c.fd);
+    clients.clear();
+    ::close(listenFd);
+    listenFd = -1;
+    unlink(path.c_str());
+}
+
+void simServer::accept() {
+    int fd;
+    while((fd = ::accept(listenFd, nullptr, nullptr)) >= 0) {
+        if(!setNonBlocking(fd)) {
+            ::close(fd);
+            continue;
+        }
+        client c;
+        c.fd = fd;
+        clients.push_back(c);
+    }
+}
+
+// reads and executes the complete command lines available, returns false if the client is gone
+bool simServer::receive(client& c) {
+    char buffer[4096];
+    ssize_t n;
+    while((n = recv(c.fd, buffer, sizeof(buffer), 0)) > 0) {
+        c.input.append(buffer, n);
+        size_t end;
+        while((end = c.input.find('\n')) != std::string::npos) {
+            const std::string reply = execute(c, c.input.substr(0, end));
+            c.input.erase(0, end + 1);
+            if(!reply.empty())
+                queue(c, serverMessageType::REPLY, reply.data(), reply.size());
+        }
+        if(c.input.size() > maxCommandLength)
+            return false;
+    }
+    return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+}
+
+// sends as much of the pending output as the socket takes without blocking, returns false if the client is gone
+bool simServer::flush(client& c) {
+    while(c.sent < c.output.size()) {
+        const ssize_t n = ::send(c.fd, c.output.data() + c.sent, c.output.size() - c.sent, MSG_NOSIGNAL);
+        if(n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        c.sent += n;
+    }
+    c.output.clear();
+    c.sent = 0;
+    c.frameEnd = 0;
+    return true;
+}
+
+/*
+    One iteration polls the sockets, executes the commands that arrived and,
+    unless paused, runs one step. Clients are only ever written to without
+    blocking, so the simulation runs at full speed whatever they do.
+*/
+void simServer::run() {
+    std::vector<pollfd> fds;
+    while(!stopping) {
+        const bool busy = running || pendingSteps > 0;
+        fds.clear();
+        fds.push_back({ listenFd, POLLIN, 0 });
+        for(const client& c : clients)
+            fds.push_back({ c.fd, (short)(POLLIN | (c.sent < c.output.size() ? POLLOUT : 0)), 0 });
+        // while paused there is nothing to do until a client sends something
+        if(::poll(fds.data(), fds.size(), busy ? 0 : -1) < 0 && errno != EINTR)
+            throw std::runtime_error(std::string("poll failed: ") + strerror(errno));
+
+        const size_t polled = clients.size();
+        for(size_t i = 0; i < polled; i++) {
+            client& c = clients[i];
+            const short revents = fds[i + 1].revents;
+            const bool wasSubscribed = c.every > 0;
+            if((revents & (POLLIN | POLLHUP | POLLERR)) && !receive(c)) {
+                ::close(c.fd);
+                c.fd = -1;
+                continue;
+            }
+            // a new subscriber gets the current state right away, also while paused
+            if(!wasSubscribed && c.every > 0) {
+                frameStep = -1;
+                sendFrame(c);
+            }
+        }
+        if(fds[0].revents & POLLIN)
+            accept();
+
+        if(busy && !stopping) {
+            try {
+                if(multithread)
+                    sim->updateMultithread();
+                else
+                    sim->update();
+                steps++;
+                if(pendingSteps > 0)
+                    pendingSteps--;
+            } catch(std::exception& e) {
+                // the state is left as the failed step made it, clients decide what to do
+                running = false;
+                pendingSteps = 0;
+                const std::string reply = std::string("error ") + e.what();
+                for(client& c : clients)
+                    if(c.fd >= 0)
+                        queue(c, serverMessageType::REPLY, reply.data(), reply.size());
+            }
+            sendFrames();
+        }
+
+        for(client& c : clients) {
+            if(c.fd >= 0 && (!flush(c) || c.output.size() - c.sent > frame.size() + maxPendingReplies)) {
+                ::close(c.fd);
+                c.fd = -1;
+            }
+        }
+        clients.erase(std::remove_if(clients.begin(), clients.end(), [](const client& c) { return c.fd < 0; }), clients.end());
+    }
+}
+
+simClient::~simClient() {
+    close();
+}
+
+void simClient::connect(const char* path) {
+    close();
+    sockaddr_un addr;
+    if(!fillAddress(path, addr))
+        throw std::runtime_error(std::string("Socket path ") + path + " is too long");
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0 || ::connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || !setNonBlocking(fd)) {
+        close();
+        throw std::runtime_error(std::string("No simulation server at ") + path);
+    }
+}
+
+void simClient::close() {
+    if(fd >= 0)
+        ::close(fd);
+    fd = -1;
+}
+
+bool simClient::send(const std::string& command) {
+    const std::string line = command + "\n";
+    size_t sent = 0;
+    while(fd >= 0 && sent < line.size()) {
+        const ssize_t n = ::send(fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+        if(n >= 0) {
+            sent += n;
+        } else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+            pollfd p = { fd, POLLOUT, 0 };
+            ::poll(&p, 1, 100);
+        } else if(errno != EINTR) {
+            close();
+        }
+    }
+    return fd >= 0;
+}
+
+bool simClient::poll() {
+    char buffer[65536];
+    ssize_t n = -1;
+    while(fd >= 0 && (n = recv(fd, buffer, sizeof(buffer), 0)) != 0) {
+        if(n < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if(errno != EINTR)
+                close();
+            continue;
+        }
+        input.insert(input.end(), buffer, buffer + n);
+    }
+    if(n == 0)
+        close();
+
+    // only the newest complete frame is decoded
+    size_t offset = 0, newestFrame = 0;
+    bool hasFrame = false;
+    while(input.size() - offset >= sizeof(serverMessage)) {
+        serverMessage header;
+        memcpy(&header, input.data() + offset, sizeof(header));
+        if(input.size() - offset - sizeof(header) < header.size)
+            break;
+        const char* payload = input.data() + offset + sizeof(header);
+        if(header.type == serverMessageType::REPLY)
+            replies.emplace_back(payload, header.size);
+        else if(header.type == serverMessageType::FRAME && header.size >= sizeof(serverFrame)) {
+            // a frame whose particles do not fit in the message is skipped like any other malformed one
+            serverFrame frame;
+            memcpy(&frame, payload, sizeof(frame));
+            if((uint64_t)frame.count * 8 + sizeof(serverFrame) <= header.size) {
+                newestFrame = offset + sizeof(header);
+                hasFrame = true;
+            }
+        }
+        offset += sizeof(header) + header.size;
+    }
+
+    if(hasFrame) {
+        serverFrame header;
+        memcpy(&header, input.data() + newestFrame, sizeof(header));
+        const int16_t* data = (const int16_t*)(input.data() + newestFrame + sizeof(header));
+        particles.assign(header.count, point { });
+        for(uint32_t i = 0; i < header.count; i++) {
+            const uint16_t* pos = (const uint16_t*)&data[4 * i];
+            particles[i].pos = glm::vec2(pos[0], pos[1]) * header.posScale;
+            particles[i].vel = glm::vec2(data[4 * i + 2], data[4 * i + 3]) * header.velScale;
+        }
+        frameStep = header.step;
+    }
+    input.erase(input.begin(), input.begin() + offset);
+    return hasFrame;
+}
+#endif
+
+bool simClient::isConnected() const {
+    return fd >= 0;
+}
+
+std::vector<std::string> simClient::takeReplies() {
+    std::vector<std::string> taken;
+    taken.swap(replies);
+    return taken;
+}
+
+const point* simClient::getParticles(int& count) const {
+    count = particles.size();
+    return particles.data();
+}
+
+long simClient::getFrameStep() const {
+    return frameStep;
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "utils.h"
+
+class fluid_sim;
+
+/*
+    Protocol of app -u <socket>, native byte order. Clients send commands as
+    text lines:
+        step [n]                        run n steps (1), then pause
+        run, pause                      step continuously, or stop
+        set <name> <value>              solver parameter, see fluid_sim::setParameter
+        get <name>
+        spawn <x> <y> <radius>          fill the free space of the circle with particles
+        force <x> <y> <radius> <vx> <vy>  add (vx, vy) to the velocity of the particles in the circle
+        subscribe [every]               stream every every-th step (1)
+        unsubscribe
+        status
+        shutdown                        stop the server
+    The server sends messages, a serverMessage followed by size bytes: REPLY
+    holds the text answer to a command, "ok ..." or "error ...", in the order
+    the commands came in. FRAME holds a serverFrame and count particles of
+    8 bytes each:
+        uint16 x, y     position in units of posScale
+        int16 vx, vy    velocity in units of velScale
+    A client is only sent a new frame once it has read the previous one,
+    frames in between are dropped for it, so a slow client never holds up the
+    simulation.
+*/
+enum class serverMessageType : uint32_t {
+    REPLY = 1,
+    FRAME = 2
+};
+
+struct serverMessage {
+    serverMessageType type;
+    uint32_t size;
+};
+
+struct serverFrame {
+    int64_t step;
+    uint32_t count;
+    // frames dropped for this client since the previous one it was sent
+    uint32_t dropped;
+    float posScale;
+    float velScale;
+};
+
+// runs a simulation and serves its clients on a Unix domain socket from one thread
+class simServer {
+private:
+    struct client {
+        int fd;
+        std::string input;
+        std::vector<char> output;
+        size_t sent = 0;
+        // offset in output just past the last frame queued, replies after it do not hold back the next one
+        size_t frameEnd = 0;
+        // 0 when not subscribed
+        int every = 0;
+        uint32_t dropped = 0;
+    };
+
+    fluid_sim* sim;
+    std::string path;
+    int width, height;
+    bool multithread;
+    int listenFd = -1;
+    std::vector<client> clients;
+
+    bool running = true;
+    long pendingSteps = 0;
+    long steps = 0;
+    std::atomic<bool> stopping{false};
+    long framesSent = 0;
+    long framesDropped = 0;
+    // the current frame, encoded once for all subscribers
+    std::vector<char> frame;
+    long frameStep = -1;
+
+    void accept();
+    bool receive(client& c);
+    bool flush(client& c);
+    std::string execute(client& c, const std::string& line);
+    void queue(client& c, serverMessageType type, const void* data, size_t size);
+    void encodeFrame();
+    void sendFrame(client& c);
+    void sendFrames();
+
+public:
+    simServer(fluid_sim* sim, const char* path, int width, int height, bool multithread);
+    ~simServer();
+
+    // creates the socket, replacing a stale one at path, throws std::runtime_error on failure
+    void open();
+    // serves clients until a client sends shutdown or stop() is called, exceptions of the solver pause it
+    void run();
+    void stop();
+    void close();
+
+    long getSteps() const;
+    long getFramesSent() const;
+    long getFramesDropped() const;
+};
+
+// connection to a simServer, used by the SDL front end as a viewer
+class simClient {
+private:
+    int fd = -1;
+    std::vector<char> input;
+    std::vector<point> particles;
+    long frameStep = -1;
+    std::vector<std::string> replies;
+
+public:
+    simClient() = default;
+    simClient(const simClient&) = delete;
+    simClient& operator=(const simClient&) = delete;
+    ~simClient();
+
+    // throws std::runtime_error if there is no server at path
+    void connect(const char* path);
+    void close();
+    bool isConnected() const;
+
+    // sends one command line, returns false if the connection is lost
+    bool send(const std::string& command);
+    // takes whatever arrived without waiting, returns true if a new frame was decoded
+    bool poll();
+    // replies received since the last call
+    std::vector<std::string> takeReplies();
+
+    // the particles of the newest frame, only position and velocity are set
+    const point* getParticles(int& count) const;
+    long getFrameStep() const;
+};
@@ -0,0 +1,104 @@
+#include <omp.h>
+#include <algorithm>
+#include "surface.h"
+
+densitySurface::densitySurface(int w, int h, int cellSize, float particleSpacing) : width(w), height(h), cellSize(cellSize) {
+    nodesX = (width + cellSize - 1) / cellSize + 1;
+    nodesY = (height + cellSize - 1) / cellSize + 1;
+    weight = particleSpacing * particleSpacing / (float)(cellSize * cellSize);
+    field.assign(nodesX * nodesY, 0.0f);
+    blurred.assign(nodesX * nodesY, 0.0f);
+    threadFields.assign(omp_get_max_threads() * nodesX * nodesY, 0.0f);
+    pixels.assign(width * height, 0);
+    depthPalette = palette::gradient(0xFF55AADD, 0xFF1A3A8A);
+}
+
+const Uint32* densitySurface::getPixels() const {
+    return pixels.data();
+}
+
+void densitySurface::splat(const glm::vec2* centers, int count) {
+    const int nodeCount = nodesX * nodesY;
+    const float invCell = 1.0f / cellSize;
+
+    #pragma omp parallel
+    {
+        const int threads = omp_get_num_threads();
+        float* own = &threadFields[omp_get_thread_num() * nodeCount];
+        std::fill(own, own + nodeCount, 0.0f);
+
+        #pragma omp for schedule(static)
+        for(int i = 0; i < count; i++) {
+            const float gx = std::min(std::max(centers[i].x * invCell, 0.0f), nodesX - 1.001f);
+            const float gy = std::min(std::max(centers[i].y * invCell, 0.0f), nodesY - 1.001f);
+            const int x = gx, y = gy;
+            const float fx = gx - x, fy = gy - y;
+            float* node = &own[y * nodesX + x];
+            node[0] += weight * (1 - fx) * (1 - fy);
+            node[1] += weight * fx * (1 - fy);
+            node[nodesX] += weight * (1 - fx) * fy;
+            node[nodesX + 1] += weight * fx * fy;
+        }
+        // implicit barrier: all splats are done
+
+        #pragma omp for schedule(static)
+        for(int n = 0; n < nodeCount; n++) {
+            float sum = 0;
+            for(int t = 0; t < threads; t++)
+                sum += threadFields[t * nodeCount + n];
+            field[n] = sum;
+        }
+
+        // separable 1 4 6 4 1 blur, clamped at the borders
+        const float taps[] = { 1 / 16.0f, 4 / 16.0f, 6 / 16.0f, 4 / 16.0f, 1 / 16.0f };
+        #pragma omp for schedule(static)
+        for(int y = 0; y < nodesY; y++) {
+            for(int x = 0; x < nodesX; x++) {
+                float sum = 0;
+                for(int k = -2; k <= 2; k++)
+                    sum += taps[k + 2] * field[y * nodesX + std::min(std::max(x + k, 0), nodesX - 1)];
+                blurred[y * nodesX + x] = sum;
+            }
+        }
+        #pragma omp for schedule(static)
+        for(int y = 0; y < nodesY; y++) {
+            for(int x = 0; x < nodesX; x++) {
+                float sum = 0;
+                for(int k = -2; k <= 2; k++)
+                    sum += taps[k + 2] * blurred[std::min(std::max(y + k, 0), nodesY - 1) * nodesX + x];
+                field[y * nodesX + x] = sum;
+            }
+        }
+    }
+}
+
+void densitySurface::shade(float threshold, Uint32 background) {
+    const float invCell = 1.0f / cellSize;
+    const float rim = threshold * 1.15f;
+    // the colour deepens from the threshold up to three times of it
+    const float depthScale = 255.0f / (2.0f * threshold);
+
+    #pragma omp parallel for schedule(static)
+    for(int py = 0; py < height; py++) {
+        const float gy = (py + 0.5f) * invCell;
+        const int y = std::min((int)gy, nodesY - 2);
+        const float fy = gy - y;
+        const float* row0 = &field[y * nodesX];
+        const float* row1 = row0 + nodesX;
+        Uint32* out = &pixels[py * width];
+        for(int px = 0; px < width; px++) {
+            const float gx = (px + 0.5f) * invCell;
+            const int x = std::min((int)gx, nodesX - 2);
+            const float fx = gx - x;
+            const float top = row0[x] + fx * (row0[x + 1] - row0[x]);
+            const float bottom = row1[x] + fx * (row1[x + 1] - row1[x]);
+            const float v = top + fy * (bottom - top);
+            if(v < threshold)
+                out[px] = background;
+            else if(v < rim)
+                out[px] = 0xFFBBE4FF;
+            else
+                out[px] = depthPalette[(int)((v - threshold) * depthScale)];
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <vector>
+#include "glm/glm.hpp"
+#include "palette.h"
+
+/*
+    Screen-space fluid surface. Particles are splatted bilinearly onto a
+    coarse grid of nodes (each thread into its own copy, summed afterwards),
+    the field is smoothed with a 5-tap binomial blur and every pixel shades
+    the bilinearly interpolated field against a threshold, so the outline is
+    the iso-contour of the field. Apart from the splat, the cost depends only
+    on the grid and window resolution.
+*/
+class densitySurface {
+private:
+    int width, height;
+    int cellSize;
+    int nodesX, nodesY;
+    // splat weight of a particle, so a fluid at rest spacing h has a field of about 1
+    float weight;
+    std::vector<float> field;
+    std::vector<float> blurred;
+    // threadFields[thread * nodeCount + node]
+    std::vector<float> threadFields;
+    std::vector<Uint32> pixels;
+    palette depthPalette;
+
+public:
+    densitySurface(int w, int h, int cellSize, float particleSpacing);
+
+    const Uint32* getPixels() const;
+
+    void splat(const glm::vec2* centers, int count);
+    // shades pixels whose field is above threshold, with a lighter rim just above it
+    void shade(float threshold, Uint32 background);
+};
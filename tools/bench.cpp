@@ -0,0 +1,210 @@
+/*
+    Benchmark suite: runs canned scenes headless at a range of particle counts,
+    with both update() and updateMultithread(), and writes one CSV row per run.
+    The tank scenes are settled with fluid_sim::settle() before they are
+    timed, for at most -w steps (settle_steps of the config by default).
+
+    usage: bench [-o output.csv] [-s max steps] [-t seconds per run] [-w max settle steps] [-p max particles]
+*/
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <chrono>
+#include <cmath>
+#include <omp.h>
+#include <libconfig.h++>
+#include "../glm/glm.hpp"
+#include "../ODE_solvers/implicitEuler.h"
+#include "../utils.h"
+#include "../mouse.h"
+#include "../fluid_sim.h"
+#include "../global.h"
+
+const char* argOpts = "o:s:t:w:p:";
+const char* generalConfigPath = "config/general.cfg";
+const char* utilsConfigPath = "config/utils.cfg";
+const char* traceOutputPath = "trace.json";
+const char* checkpointPath = "checkpoint.bin";
+
+enum class scene {
+    DAM_BREAK,
+    SETTLED_TANK,
+    STIRRED_TANK,
+    DOUBLE_DAM_BREAK
+};
+
+static const char* sceneName(scene s) {
+    switch(s) {
+    case scene::DAM_BREAK:
+        return "dam_break";
+    case scene::SETTLED_TANK:
+        return "settled_tank";
+    case scene::STIRRED_TANK:
+        return "stirred_tank";
+    case scene::DOUBLE_DAM_BREAK:
+        return "double_dam_break";
+    default:
+        return "unknown";
+    }
+}
+
+struct benchSettings {
+    int maxSteps = 50;
+    double secondsPerRun = 5.0;
+    int settleSteps = 2000;
+};
+
+struct benchResult {
+    // steps fluid_sim::settle() took before the timed run and whether it converged, 0 and false for scenes that start moving
+    int settleSteps;
+    bool settled;
+    int particles;
+    int steps;
+    int substeps;
+    double seconds;
+};
+
+// square domain holding a block of n particles in a quarter of its area, rounded to whole cells
+static int domainSize(int n, float h, int cellSize) {
+    const int side = 2 * (int)std::ceil(std::sqrt((float)n) * h) + 2 * cellSize;
+    return (side + cellSize - 1) / cellSize * cellSize;
+}
+
+// a block of n particles with its bottom left corner at from
+static void generateBlock(fluid_sim* sim, glm::ivec2 from, int n, float h) {
+    const int cols = std::ceil(std::sqrt((float)n));
+    const int rows = (n + cols - 1) / cols;
+    glm::ivec2 to = { from.x + (int)(cols * h), from.y };
+    from.y -= (int)(rows * h);
+    sim->generateParticles(from, to, h);
+}
+
+// scripted stirring: the cursor circles around the middle of the tank with the left button held
+static void stir(fluid_sim* sim, int step, int size, int fluidTop) {
+    mouse* m = sim->getMouseObject();
+    const float angle = step * 0.1f;
+    const float radius = 0.25f * size;
+    const float depth = size - 11 - fluidTop;
+    m->setLB(true);
+    m->updatePos(glm::vec2(0.5f * size + radius * std::cos(angle), fluidTop + 0.5f * depth + 0.4f * depth * std::sin(angle)));
+}
+
+static benchResult runScene(libconfig::Config& cfg, ODESolver* integrator, scene s, int n, bool multithread, const benchSettings& settings) {
+    const float h = cfg.lookup("h");
+    const int cellSize = cfg.lookup("cell_size");
+    const int size = domainSize(n, h, cellSize);
+    const int ground = size - 11;
+    cfg.lookup("max_particles") = n;
+
+    fluid_sim* sim = new fluid_sim();
+    sim->setup(cfg, utConf::cfg, generalConfigPath, size, size, integrator);
+
+    int fluidTop = ground;
+    int settleSteps = 0;
+    bool settled = false;
+    switch(s) {
+    case scene::DAM_BREAK:
+        generateBlock(sim, { 0, ground }, n, h);
+        break;
+    case scene::DOUBLE_DAM_BREAK: {
+        generateBlock(sim, { 0, ground }, n / 2, h);
+        const int cols = std::ceil(std::sqrt((float)(n - n / 2)));
+        generateBlock(sim, { size - 1 - (int)(cols * h), ground }, n - n / 2, h);
+        break;
+    }
+    case scene::SETTLED_TANK:
+    case scene::STIRRED_TANK: {
+        const int cols = (size - 1) / h;
+        const int rows = (n + cols - 1) / cols;
+        fluidTop = ground - (int)(rows * h);
+        sim->generateParticles({ 0, fluidTop }, { size - 1, ground }, h);
+        // time the steady state, not the sloshing of the freshly generated block
+        settleSteps = sim->settle(settings.settleSteps, multithread);
+        settled = sim->getSleepingCount() >= 0.95 * sim->getParticleCount();
+        break;
+    }
+    }
+
+    benchResult result = { settleSteps, settled, sim->getParticleCount(), 0, sim->getNumIterations(), 0.0 };
+    auto start = std::chrono::steady_clock::now();
+    for(; result.steps < settings.maxSteps; result.steps++) {
+        if(s == scene::STIRRED_TANK)
+            stir(sim, result.steps, size, fluidTop);
+        if(multithread)
+            sim->updateMultithread();
+        else
+            sim->update();
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        result.seconds = elapsed.count();
+        if(result.seconds > settings.secondsPerRun) {
+            result.steps++;
+            break;
+        }
+    }
+
+    sim->destroy();
+    delete sim;
+    return result;
+}
+
+int main(int argc, char** argv) {
+    const char* outputPath = getOptionArg(argc, argv, 'o');
+    benchSettings settings;
+    if(getOption(argc, argv, 's'))
+        settings.maxSteps = atoi(getOptionArg(argc, argv, 's'));
+    if(getOption(argc, argv, 't'))
+        settings.secondsPerRun = atof(getOptionArg(argc, argv, 't'));
+    const int maxParticles = getOption(argc, argv, 'p') ? atoi(getOptionArg(argc, argv, 'p')) : 1 << 20;
+
+    libconfig::Config cfg;
+    try {
+        parseConfig(cfg, generalConfigPath);
+        utConf::parseConfig();
+        settings.settleSteps = getOption(argc, argv, 'w') ? atoi(getOptionArg(argc, argv, 'w')) : (int)cfg.lookup("settle_steps");
+    } catch(std::exception& e) {
+        std::cout << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    glm::vec2 G;
+    G.x = cfg.lookup("gravity.x");
+    G.y = cfg.lookup("gravity.y");
+    implicitEuler _integrator([=](float t, glm::vec2 y, glm::vec2 z, glm::vec2 zdash) -> glm::vec2 {
+        return zdash + G;
+    });
+
+    std::ofstream out(outputPath ? outputPath : "bench_results.csv");
+    if(!out) {
+        std::cout << "Cannot open output file" << std::endl;
+        return EXIT_FAILURE;
+    }
+    out << "scene,mode,threads,particles,settle_steps,settled,steps,substeps_per_step,seconds,steps_per_second,ns_per_particle_substep" << std::endl;
+
+    const scene scenes[] = { scene::DAM_BREAK, scene::SETTLED_TANK, scene::STIRRED_TANK, scene::DOUBLE_DAM_BREAK };
+    for(scene s : scenes) {
+        for(int n = 2048; n <= maxParticles; n *= 2) {
+            for(int mt = 0; mt < 2; mt++) {
+                benchResult r;
+                try {
+                    r = runScene(cfg, (ODESolver*)&_integrator, s, n, mt, settings);
+                } catch(std::exception& e) {
+                    std::cout << sceneName(s) << " " << n << ": " << e.what() << std::endl;
+                    continue;
+                }
+                const double stepsPerSecond = r.steps / r.seconds;
+                const double nsPerParticleSubstep = r.seconds * 1e9 / ((double)r.particles * r.steps * r.substeps);
+                out << sceneName(s) << "," << (mt ? "multithread" : "single") << "," << (mt ? omp_get_max_threads() : 1) << ","
+                    << r.particles << "," << r.settleSteps << "," << r.settled << "," << r.steps << "," << r.substeps << "," << r.seconds << ","
+                    << stepsPerSecond << "," << nsPerParticleSubstep << std::endl;
+                std::cout << sceneName(s) << " " << (mt ? "multithread" : "single") << " " << r.particles << " particles: "
+                    << stepsPerSecond << " steps/s, " << nsPerParticleSubstep << " ns/particle-substep";
+                if(r.settleSteps > 0)
+                    std::cout << " (" << (r.settled ? "settled in " : "not settled after ") << r.settleSteps << " steps)";
+                std::cout << std::endl;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,42 @@
+/*
+    Embeds the solver through the C interface of libfluidsim.a: drops a block
+    of fluid into a tank, steps it and prints where the fluid ended up.
+
+    usage: capi_example [steps]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "../fluid_sim_c.h"
+
+int main(int argc, char** argv) {
+    const int steps = argc > 1 ? atoi(argv[1]) : 100;
+
+    fsim* sim = fsim_create(NULL, NULL, 256, 256);
+    if(!sim) {
+        fprintf(stderr, "%s\n", fsim_last_error());
+        return EXIT_FAILURE;
+    }
+
+    float h;
+    fsim_get_param(sim, "h", &h);
+    const int added = fsim_add_block(sim, 0, 100, 128, 245, h);
+    printf("%d particles\n", added);
+
+    if(fsim_step(sim, steps) != 0) {
+        fprintf(stderr, "%s\n", fsim_last_error());
+        fsim_destroy(sim);
+        return EXIT_FAILURE;
+    }
+
+    int count;
+    const fsim_particle* particles = fsim_particles(sim, &count);
+    double x = 0, y = 0;
+    for(int i = 0; i < count; i++) {
+        x += particles[i].pos[0];
+        y += particles[i].pos[1];
+    }
+    printf("centre of mass after %d steps: %.2f, %.2f\n", steps, x / count, y / count);
+
+    fsim_destroy(sim);
+    return 0;
+}
@@ -0,0 +1,182 @@
+/*
+    Ensemble runner: simulates every combination of the parameter values in
+    config/ensemble.cfg headless in one process and writes one CSV row per
+    member. Members share the OpenMP thread pool: small ones run side by side
+    with the single threaded solver, one per thread, members with at least
+    split_particles particles run one after another with the multithreaded solver.
+
+    usage: ensemble [-c ensemble config] [-o output.csv] [-n steps]
+*/
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <omp.h>
+#include <libconfig.h++>
+#include "../glm/glm.hpp"
+#include "../ODE_solvers/implicitEuler.h"
+#include "../utils.h"
+#include "../fluid_sim.h"
+#include "../global.h"
+
+const char* argOpts = "c:o:n:";
+const char* generalConfigPath = "config/general.cfg";
+const char* utilsConfigPath = "config/utils.cfg";
+const char* traceOutputPath = "trace.json";
+const char* checkpointPath = "checkpoint.bin";
+
+struct sweepAxis {
+    std::string name;
+    std::vector<double> values;
+};
+
+struct member {
+    std::vector<double> values;
+    fluid_sim* sim = nullptr;
+    int steps = 0;
+    double seconds = 0;
+    stateSummary summary = { };
+    std::string error;
+};
+
+static std::vector<sweepAxis> readSweep(const libconfig::Setting& sweep) {
+    std::vector<sweepAxis> axes;
+    for(int i = 0; i < sweep.getLength(); i++) {
+        const libconfig::Setting& values = sweep[i];
+        sweepAxis axis = { values.getName(), { } };
+        for(int j = 0; j < values.getLength(); j++)
+            axis.values.push_back(values[j]);
+        if(axis.values.empty())
+            throw std::runtime_error("Sweep of " + axis.name + " has no values");
+        axes.push_back(axis);
+    }
+    return axes;
+}
+
+// replaces a setting of the general config, keeping its type
+static void assignSetting(libconfig::Config& cfg, const std::string& name, double value) {
+    libconfig::Setting& setting = cfg.lookup(name);
+    if(setting.getType() == libconfig::Setting::TypeInt)
+        setting = (int)std::lround(value);
+    else
+        setting = (float)value;
+}
+
+static void runMember(member& m, int steps, bool multithread) {
+    auto start = std::chrono::steady_clock::now();
+    try {
+        for(; m.steps < steps; m.steps++) {
+            if(multithread)
+                m.sim->updateMultithread();
+            else
+                m.sim->update();
+        }
+    } catch(std::exception& e) {
+        m.error = e.what();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    m.seconds = elapsed.count();
+    m.summary = m.sim->collectStateSummary();
+}
+
+int main(int argc, char** argv) {
+    const char* ensembleConfigPath = getOptionArg(argc, argv, 'c');
+    const char* outputPath = getOptionArg(argc, argv, 'o');
+
+    libconfig::Config cfg, ensembleCfg;
+    std::vector<sweepAxis> axes;
+    int steps, width, height, splitParticles;
+    try {
+        parseConfig(cfg, generalConfigPath);
+        parseConfig(ensembleCfg, ensembleConfigPath ? ensembleConfigPath : "config/ensemble.cfg");
+        utConf::parseConfig();
+        steps = getOption(argc, argv, 'n') ? atoi(getOptionArg(argc, argv, 'n')) : (int)ensembleCfg.lookup("steps");
+        width = ensembleCfg.lookup("width");
+        height = ensembleCfg.lookup("height");
+        splitParticles = ensembleCfg.lookup("split_particles");
+        axes = readSweep(ensembleCfg.lookup("sweep"));
+    } catch(std::exception& e) {
+        std::cout << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    glm::vec2 G;
+    G.x = cfg.lookup("gravity.x");
+    G.y = cfg.lookup("gravity.y");
+    implicitEuler _integrator([=](float t, glm::vec2 y, glm::vec2 z, glm::vec2 zdash) -> glm::vec2 {
+        return zdash + G;
+    });
+
+    // members in row-major order of the sweep, the last axis varying fastest
+    size_t count = 1;
+    for(const sweepAxis& axis : axes)
+        count *= axis.values.size();
+    std::vector<member> members(count);
+    for(size_t i = 0; i < count; i++) {
+        size_t rest = i;
+        members[i].values.resize(axes.size());
+        for(size_t a = axes.size(); a-- > 0;) {
+            members[i].values[a] = axes[a].values[rest % axes[a].values.size()];
+            rest /= axes[a].values.size();
+        }
+    }
+
+    // setup reads the shared config, so members are created one at a time
+    auto start = std::chrono::steady_clock::now();
+    std::vector<member*> small, large;
+    for(member& m : members) {
+        try {
+            for(size_t a = 0; a < axes.size(); a++)
+                assignSetting(cfg, axes[a].name, m.values[a]);
+            m.sim = new fluid_sim();
+            m.sim->setup(cfg, utConf::cfg, generalConfigPath, width, height, (ODESolver*)&_integrator);
+            m.sim->generateInitialParticles();
+        } catch(std::exception& e) {
+            m.error = e.what();
+            delete m.sim;
+            m.sim = nullptr;
+            continue;
+        }
+        (m.sim->getParticleCount() >= splitParticles ? large : small).push_back(&m);
+    }
+
+    for(member* m : large)
+        runMember(*m, steps, true);
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int i = 0; i < (int)small.size(); i++)
+        runMember(*small[i], steps, false);
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::ofstream out(outputPath ? outputPath : "ensemble_results.csv");
+    if(!out) {
+        std::cout << "Cannot open output file" << std::endl;
+        return EXIT_FAILURE;
+    }
+    out << "member";
+    for(const sweepAxis& axis : axes)
+        out << "," << axis.name;
+    out << ",particles,steps,seconds,steps_per_second,sleeping,mean_density,max_density,mean_speed,max_speed,kinetic_energy,error" << std::endl;
+    for(size_t i = 0; i < count; i++) {
+        const member& m = members[i];
+        const stateSummary& s = m.summary;
+        out << i;
+        for(double v : m.values)
+            out << "," << v;
+        out << "," << s.particles << "," << m.steps << "," << m.seconds << "," << (m.seconds > 0 ? m.steps / m.seconds : 0)
+            << "," << s.sleeping << "," << s.meanDensity << "," << s.maxDensity << "," << s.meanSpeed << "," << s.maxSpeed
+            << "," << s.kineticEnergy << "," << m.error << std::endl;
+        if(m.sim) {
+            m.sim->destroy();
+            delete m.sim;
+        }
+    }
+
+    std::cout << count << " members (" << large.size() << " split across threads) ran " << steps << " steps in "
+        << elapsed.count() << " s on " << omp_get_max_threads() << " threads" << std::endl;
+    return 0;
+}
@@ -0,0 +1,85 @@
+/*
+    Sample consumer of the shared memory particle feed of app -b <name>. It
+    follows the newest frame, reads the particles in place and prints once a
+    second how many frames it consumed, how many it skipped because a newer
+    one was already complete, and how many the writer overwrote while they
+    were being read.
+
+    usage: feedreader <name> [frames]
+*/
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+#include <thread>
+#include "../particlefeed.h"
+
+int main(int argc, char** argv) {
+    if(argc < 2 || argc > 3) {
+        std::cerr << "usage: feedreader <name> [frames]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const long maxFrames = argc > 2 ? atol(argv[2]) : 0;
+
+    particleFeedReader feed;
+    try {
+        feed.open(argv[1]);
+    } catch(std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    const particleFeedHeader& header = feed.getHeader();
+    std::cout << header.width << "x" << header.height << ", " << header.slotCount << " slots of " << header.capacity << " particles" << std::endl;
+
+    long consumed = 0, skipped = 0, overwritten = 0;
+    uint64_t next = feed.getLatest();
+    auto reportTime = std::chrono::steady_clock::now();
+    while(maxFrames == 0 || consumed < maxFrames) {
+        const uint64_t latest = feed.getLatest();
+        if(latest == next) {
+            if(feed.isClosed())
+                break;
+            // nothing new, the only time the reader leaves user space
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            continue;
+        }
+
+        const uint64_t frame = latest - 1;
+        skipped += frame - next;
+        next = latest;
+        const particleFeedSlot* slot = feed.acquire(frame);
+        if(!slot) {
+            overwritten++;
+            continue;
+        }
+        const long step = slot->step;
+        // a slot being overwritten can hold any count, validate() only rejects the frame afterwards
+        const int count = std::min(slot->particleCount, header.capacity);
+        const float* particles = feed.getParticles(slot);
+        double x = 0, y = 0, speed = 0;
+        for(int i = 0; i < count; i++) {
+            x += particles[4 * i];
+            y += particles[4 * i + 1];
+            speed += std::sqrt(particles[4 * i + 2] * particles[4 * i + 2] + particles[4 * i + 3] * particles[4 * i + 3]);
+        }
+        if(!feed.validate(slot, frame)) {
+            overwritten++;
+            continue;
+        }
+        consumed++;
+
+        const auto now = std::chrono::steady_clock::now();
+        if(now - reportTime >= std::chrono::seconds(1) || consumed == maxFrames) {
+            reportTime = now;
+            std::cout << "substep " << step << ": " << count << " particles, centre " << x / count << ", " << y / count
+                << ", mean speed " << speed / count << " | " << consumed << " frames read, " << skipped << " skipped, "
+                << overwritten << " overwritten" << std::endl;
+        }
+    }
+
+    std::cout << (feed.isClosed() ? "Feed closed, " : "") << consumed << " frames read, " << skipped << " skipped, "
+        << overwritten << " overwritten" << std::endl;
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*
+    Reads a simulation config and emits a header with its solver parameters,
+    the grid dimensions for a domain of width x height and the neighbour
+    stencil as constexpr values, used by the FIXED_CONFIG build (make fixed).
+    usage: genconfig <config file> <output header> <width> <height>
+*/
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <string>
+#include <libconfig.h++>
+
+static std::string floatLiteral(float v) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.9ef", v);
+    return buf;
+}
+
+int main(int argc, char** argv) {
+    if(argc != 5) {
+        std::cerr << "usage: genconfig <config file> <output header> <width> <height>" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const int width = atoi(argv[3]), height = atoi(argv[4]);
+
+    libconfig::Config cfg;
+    float K, h, p0, e, mass;
+    int cellSize, stencilRadius;
+    try {
+        cfg.readFile(argv[1]);
+        K = cfg.lookup("K");
+        h = cfg.lookup("h");
+        p0 = cfg.lookup("p0");
+        e = cfg.lookup("viscosity");
+        mass = cfg.lookup("mass");
+        cellSize = cfg.lookup("cell_size");
+        stencilRadius = cfg.lookup("stencil_radius");
+    } catch(std::exception& ex) {
+        std::cerr << "Error reading " << argv[1] << ": " << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    if(width < 1 || height < 1 || cellSize < 1 || stencilRadius < 1 || stencilRadius > 3) {
+        std::cerr << "Invalid domain size, cell_size or stencil_radius" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream out(argv[2]);
+    if(!out) {
+        std::cerr << "Cannot write " << argv[2] << std::endl;
+        return EXIT_FAILURE;
+    }
+    out << "#pragma once\n"
+        << "// generated by genconfig from " << argv[1] << ", do not edit\n"
+        << "#include \"kernels.h\"\n"
+        << "#include \"fluid_sim.h\"\n\n"
+        << "struct fixedParams {\n"
+        << "    static constexpr float K = " << floatLiteral(K) << ";\n"
+        << "    static constexpr float h = " << floatLiteral(h) << ";\n"
+        << "    static constexpr float h2 = h * h;\n"
+        << "    static constexpr float p0 = " << floatLiteral(p0) << ";\n"
+        << "    static constexpr float e = " << floatLiteral(e) << ";\n"
+        << "    static constexpr float mass = " << floatLiteral(mass) << ";\n"
+        << "    static constexpr int cellSize = " << cellSize << ";\n"
+        << "    static constexpr int stencilRadius = " << stencilRadius << ";\n"
+        << "    static constexpr int width = " << width << ";\n"
+        << "    static constexpr int height = " << height << ";\n"
+        << "    static constexpr int gridDimX = (width + cellSize - 1) / cellSize;\n"
+        << "    static constexpr int gridDimY = (height + cellSize - 1) / cellSize;\n"
+        << "    static constexpr int gridStride = gridDimX + 2 * stencilRadius;\n"
+        << "    static constexpr gridStencil<stencilRadius> stencil{ gridStride };\n"
+        << "#if defined(KERNEL_TABLES)\n"
+        << "    static inline const sphKernels kernels{ h };\n"
+        << "#else\n"
+        << "    static constexpr sphKernels kernels{ h };\n"
+        << "#endif\n"
+        << "};\n";
+    return 0;
+}
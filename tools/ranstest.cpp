@@ -0,0 +1,58 @@
+/*
+    Round-trips the rANS coder on streams that compress well, poorly and not
+    at all, and on truncated blocks. Exits non-zero on the first failure.
+
+    usage: ranstest
+*/
+#include <iostream>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include "../rans.h"
+
+static int failures = 0;
+
+static void roundTrip(const std::string& name, const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> block;
+    ransEncode(data.data(), data.size(), block);
+    std::vector<uint8_t> decoded(data.size());
+    const size_t used = ransDecode(block.data(), block.size(), decoded.data(), decoded.size());
+    bool ok = used == block.size() && decoded == data;
+    // the block is stored once coding does not pay off, so it never grows much beyond the data
+    ok = ok && block.size() <= data.size() + 6 + 3 * 256;
+    // a truncated block must be rejected, not read past its end
+    if(!data.empty())
+        ok = ok && ransDecode(block.data(), block.size() - 1, decoded.data(), decoded.size()) == 0;
+    std::cout << (ok ? "ok   " : "FAIL ") << name << ": " << data.size() << " -> " << block.size() << " bytes" << std::endl;
+    failures += !ok;
+}
+
+int main() {
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> byte(0, 255);
+
+    roundTrip("empty", { });
+    roundTrip("single byte", { 42 });
+    roundTrip("constant", std::vector<uint8_t>(100000, 7));
+
+    std::vector<uint8_t> data(100000);
+    for(uint8_t& b : data)
+        b = byte(rng);
+    roundTrip("uniform", data);
+    for(size_t n : { 1, 2, 3, 5, 17, 255, 4096 })
+        roundTrip("uniform prefix", std::vector<uint8_t>(data.begin(), data.begin() + n));
+
+    std::geometric_distribution<int> small(0.5);
+    for(uint8_t& b : data)
+        b = std::min(small(rng), 255);
+    roundTrip("skewed", data);
+
+    // half skewed, half uniform, still worth coding
+    for(size_t i = data.size() / 2; i < data.size(); i++)
+        data[i] = byte(rng);
+    roundTrip("mixed", data);
+
+    std::cout << (failures ? "FAILED" : "All passed") << std::endl;
+    return failures ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,70 @@
+/*
+    Prints the layout of a trajectory recorded with app -o, and decodes a
+    single frame to CSV (x, y, vx, vy per particle) when one is given.
+    usage: trajinfo <trajectory> [frame [output.csv]]
+*/
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+#include "../glm/glm.hpp"
+#include "../trajectory.h"
+
+int main(int argc, char** argv) {
+    if(argc < 2 || argc > 4) {
+        std::cerr << "usage: trajinfo <trajectory> [frame [output.csv]]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    trajectoryReader reader;
+    try {
+        reader.open(argv[1]);
+    } catch(std::exception& e) {
+        std::cerr << argv[1] << ": " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const trajectoryHeader& header = reader.getHeader();
+    const size_t frames = reader.getFrameCount();
+    long particleFrames = 0;
+    for(size_t f = 0; f < frames; f++)
+        particleFrames += reader.getParticleCount(f);
+    std::ifstream file(argv[1], std::ios::binary | std::ios::ate);
+    const long bytes = file.tellg();
+
+    std::cout << header.width << "x" << header.height << ", cell size " << header.cellSize << ", velocity quantum " << header.velQuantum << std::endl;
+    std::cout << frames << " frames, every " << header.stride << " substeps, keyframe every " << header.keyframeInterval << std::endl;
+    if(frames > 0)
+        std::cout << "steps " << reader.getStep(0) << " to " << reader.getStep(frames - 1) << ", " << reader.getParticleCount(frames - 1) << " particles in the last frame" << std::endl;
+    if(particleFrames > 0)
+        std::cout << bytes << " bytes, " << (double)bytes / particleFrames << " bytes per particle and frame" << std::endl;
+
+    if(argc < 3)
+        return 0;
+
+    const size_t frame = atol(argv[2]);
+    std::vector<glm::vec2> positions, velocities;
+    auto start = std::chrono::steady_clock::now();
+    try {
+        reader.readFrame(frame, positions, velocities);
+    } catch(std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "frame " << frame << " (step " << reader.getStep(frame) << ") decoded in " << elapsed.count() << " ms" << std::endl;
+
+    if(argc < 4)
+        return 0;
+    std::ofstream out(argv[3]);
+    if(!out) {
+        std::cerr << "Cannot open " << argv[3] << std::endl;
+        return EXIT_FAILURE;
+    }
+    out << "x,y,vx,vy" << std::endl;
+    for(size_t i = 0; i < positions.size(); i++)
+        out << positions[i].x << "," << positions[i].y << "," << velocities[i].x << "," << velocities[i].y << std::endl;
+    return 0;
+}
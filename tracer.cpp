@@ -0,0 +1,61 @@
+#include <chrono>
+#include <fstream>
+#include "tracer.h"
+
+bool tracer::enabled = false;
+std::mutex tracer::registryMutex;
+std::vector<tracer::threadBuffer*> tracer::buffers;
+
+static const auto traceStart = std::chrono::steady_clock::now();
+
+// microseconds since program start
+int64_t tracer::now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - traceStart).count();
+}
+
+tracer::threadBuffer* tracer::registerThread() {
+    threadBuffer* buf = new threadBuffer;
+    buf->count = 0;
+    buf->events.resize(bufferSize);
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    buf->tid = buffers.size();
+    buffers.push_back(buf);
+    return buf;
+}
+
+void tracer::record(const char* name, int64_t begin, int64_t end) {
+    thread_local threadBuffer* buf = registerThread();
+    const uint64_t idx = buf->count.load(std::memory_order_relaxed);
+    buf->events[idx % bufferSize] = { name, begin, end };
+    buf->count.store(idx + 1, std::memory_order_release);
+}
+
+/*
+    Must be called while no other thread is recording, e.g. between frames.
+    Buffers that wrapped around only contain their most recent events.
+*/
+bool tracer::dump(const char* path) {
+    std::ofstream out(path);
+    if(!out)
+        return false;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for(threadBuffer* buf : buffers) {
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buf->tid
+            << ",\"args\":{\"name\":\"thread " << buf->tid << "\"}}";
+        first = false;
+
+        const uint64_t count = buf->count.load(std::memory_order_acquire);
+        const uint64_t from = count > bufferSize ? count - bufferSize : 0;
+        for(uint64_t i = from; i < count; i++) {
+            const traceEvent& ev = buf->events[i % bufferSize];
+            out << ",\n{\"name\":\"" << ev.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buf->tid
+                << ",\"ts\":" << ev.begin << ",\"dur\":" << ev.end - ev.begin << "}";
+        }
+    }
+    out << "\n]}\n";
+    return (bool)out;
+}
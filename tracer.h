@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct traceEvent {
+    const char* name;
+    int64_t begin;
+    int64_t end;
+};
+
+/*
+    Records timed events per thread into fixed-size ring buffers, each only
+    ever written by its own thread, and writes them out as Chrome/Perfetto
+    trace JSON. When tracing is disabled, recording costs a single branch on
+    tracer::enabled.
+*/
+class tracer {
+public:
+    static bool enabled;
+
+    static int64_t now();
+    static void record(const char* name, int64_t begin, int64_t end);
+    static bool dump(const char* path);
+
+private:
+    static const int bufferSize = 1 << 16;
+
+    struct threadBuffer {
+        int tid;
+        std::atomic<uint64_t> count;
+        std::vector<traceEvent> events;
+    };
+
+    static std::mutex registryMutex;
+    static std::vector<threadBuffer*> buffers;
+
+    static threadBuffer* registerThread();
+};
+
+// records an event spanning the lifetime of the object, if tracing was enabled when it was created
+class traceScope {
+private:
+    const char* name;
+    bool started;
+    int64_t begin;
+
+public:
+    traceScope(const char* name) : name(name), started(tracer::enabled), begin(started ? tracer::now() : 0) { }
+
+    ~traceScope() {
+        if(started)
+            tracer::record(name, begin, tracer::now());
+    }
+};
@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include "rans.h"
+#include "trajectory.h"
+
+static uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v) {
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+// fixed point position in 1/256 of a cell, clamped to the grid
+static int32_t quantizePosition(float x, float cellSize, int cells) {
+    const int32_t q = (int32_t)(x / cellSize * 256.0f);
+    return std::min(std::max(q, 0), cells * 256 - 1);
+}
+
+static int32_t quantizeVelocity(float v, float quantum) {
+    const float q = std::round(v / quantum);
+    return (int32_t)std::min(std::max(q, -1e9f), 1e9f);
+}
+
+void trajectoryState::resize(size_t n) {
+    cells.resize(n);
+    offsets.resize(2 * n);
+    velocities.resize(2 * n);
+}
+
+trajectoryWriter::trajectoryWriter(const char* path, int width, int height, float cellSize, float velQuantum, int stride, int keyframeInterval, int queueSize)
+    : path(path) {
+    memcpy(header.magic, trajectoryMagic, sizeof(header.magic));
+    header.version = trajectoryVersion;
+    header.byteOrder = checkpointByteOrder;
+    header.width = width;
+    header.height = height;
+    header.cellSize = cellSize;
+    header.velQuantum = velQuantum;
+    header.stride = std::max(1, stride);
+    header.keyframeInterval = std::max(1, keyframeInterval);
+    cols = (int)std::ceil(width / cellSize) + 1;
+
+    buffers.resize(std::max(1, queueSize));
+    for(int i = 0; i < (int)buffers.size(); i++)
+        freeBuffers.push_back(i);
+}
+
+trajectoryWriter::~trajectoryWriter() {
+    finish();
+}
+
+bool trajectoryWriter::start() {
+    out = fopen(path.c_str(), "wb");
+    if(!out || !writeBytes(&header, sizeof(header)))
+        return false;
+    writer = std::thread(&trajectoryWriter::writeLoop, this);
+    return true;
+}
+
+int trajectoryWriter::getStride() const {
+    return header.stride;
+}
+
+float* trajectoryWriter::beginFrame(long step, int count) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        bufferFreed.wait(lock, [this] { return !freeBuffers.empty(); });
+        filling = freeBuffers.front();
+        freeBuffers.pop_front();
+    }
+
+    // the buffer belongs to this thread until it is queued
+    frame& f = buffers[filling];
+    f.step = step;
+    f.count = count;
+    f.data.resize(4 * (size_t)count);
+    return f.data.data();
+}
+
+void trajectoryWriter::commitFrame() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queuedBuffers.push_back(filling);
+        filling = -1;
+    }
+    frameQueued.notify_one();
+}
+
+void trajectoryWriter::writeLoop() {
+    trajectoryState prev;
+    std::vector<uint8_t> planes, chunk;
+    while(true) {
+        int buffer;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            frameQueued.wait(lock, [this] { return stopping || !queuedBuffers.empty(); });
+            if(queuedBuffers.empty())
+                return;
+            buffer = queuedBuffers.front();
+            queuedBuffers.pop_front();
+        }
+
+        // after a write error the remaining frames are only recycled
+        const bool ok = !failed && writeFrame(buffers[buffer], prev, planes, chunk);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            freeBuffers.push_back(buffer);
+            if(ok)
+                particleFrames += buffers[buffer].count;
+            else
+                failed = true;
+        }
+        bufferFreed.notify_one();
+    }
+}
+
+bool trajectoryWriter::writeFrame(const frame& f, trajectoryState& prev, std::vector<uint8_t>& planes, std::vector<uint8_t>& chunk) {
+    const size_t n = f.count;
+    const bool keyframe = index.size() % header.keyframeInterval == 0;
+    if(keyframe)
+        prev = trajectoryState();
+    // particles that were not in the previous frame are coded against zero
+    prev.resize(n);
+
+    const int rows = (int)std::ceil(header.height / header.cellSize) + 1;
+    planes.resize(n * framePlaneCount);
+    uint8_t* plane[framePlaneCount];
+    for(int p = 0; p < framePlaneCount; p++)
+        plane[p] = planes.data() + p * n;
+
+    for(size_t i = 0; i < n; i++) {
+        const float* d = &f.data[4 * i];
+        const int32_t qx = quantizePosition(d[0], header.cellSize, cols);
+        const int32_t qy = quantizePosition(d[1], header.cellSize, rows);
+        const int32_t cell = (qy >> 8) * cols + (qx >> 8);
+        const uint8_t offset[2] = { (uint8_t)qx, (uint8_t)qy };
+        const int32_t vel[2] = { quantizeVelocity(d[2], header.velQuantum), quantizeVelocity(d[3], header.velQuantum) };
+
+        const uint32_t dc = zigzag((int32_t)((uint32_t)cell - (uint32_t)prev.cells[i]));
+        for(int b = 0; b < 4; b++)
+            plane[b][i] = dc >> (8 * b);
+        for(int a = 0; a < 2; a++) {
+            plane[4 + a][i] = offset[a] - prev.offsets[2 * i + a];
+            const uint32_t dv = zigzag((int32_t)((uint32_t)vel[a] - (uint32_t)prev.velocities[2 * i + a]));
+            for(int b = 0; b < 4; b++)
+                plane[6 + 4 * a + b][i] = dv >> (8 * b);
+        }
+
+        prev.cells[i] = cell;
+        prev.offsets[2 * i] = offset[0];
+        prev.offsets[2 * i + 1] = offset[1];
+        prev.velocities[2 * i] = vel[0];
+        prev.velocities[2 * i + 1] = vel[1];
+    }
+
+    chunk.clear();
+    for(int p = 0; p < framePlaneCount; p++)
+        ransEncode(plane[p], n, chunk);
+
+    const trajectoryChunk c = { f.step, (uint32_t)n, keyframe, chunk.size() };
+    index.push_back({ f.step, offset });
+    return writeBytes(&c, sizeof(c)) && writeBytes(chunk.data(), chunk.size());
+}
+
+bool trajectoryWriter::writeBytes(const void* data, size_t size) {
+    if(fwrite(data, 1, size, out) != size)
+        return false;
+    offset += size;
+    return true;
+}
+
+void trajectoryWriter::finish() {
+    if(!writer.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    frameQueued.notify_one();
+    writer.join();
+
+    // without the index and footer the reader rejects the file
+    trajectoryFooter footer = { offset, index.size(), { } };
+    memcpy(footer.magic, trajectoryMagic, sizeof(footer.magic));
+    if(failed || !writeBytes(index.data(), index.size() * sizeof(trajectoryIndexEntry)) || !writeBytes(&footer, sizeof(footer)))
+        failed = true;
+    if(fclose(out) != 0)
+        failed = true;
+    out = nullptr;
+}
+
+long trajectoryWriter::getWritten() const {
+    return index.size();
+}
+
+uint64_t trajectoryWriter::getBytes() const {
+    return offset;
+}
+
+double trajectoryWriter::getBytesPerParticle() const {
+    return particleFrames ? (double)offset / particleFrames : 0.0;
+}
+
+bool trajectoryWriter::hasFailed() const {
+    return failed;
+}
+
+void trajectoryReader::open(const char* path) {
+    if(!file.open(path))
+        throw std::runtime_error(std::string("Cannot open trajectory ") + path);
+    const char* data = file.getData();
+    const size_t size = file.getSize();
+    if(size < sizeof(trajectoryHeader) + sizeof(trajectoryFooter))
+        throw std::runtime_error("Trajectory file is truncated");
+
+    memcpy(&header, data, sizeof(header));
+    if(memcmp(header.magic, trajectoryMagic, sizeof(header.magic)) != 0)
+        throw std::runtime_error("Not a trajectory file");
+    if(header.version < 1 || header.version > trajectoryVersion || header.byteOrder != checkpointByteOrder)
+        throw std::runtime_error("Trajectory was written by an incompatible build");
+    if(!(header.cellSize > 0) || header.keyframeInterval < 1)
+        throw std::runtime_error("Trajectory header is corrupt");
+
+    trajectoryFooter footer;
+    memcpy(&footer, data + size - sizeof(footer), sizeof(footer));
+    if(memcmp(footer.magic, trajectoryMagic, sizeof(footer.magic)) != 0)
+        throw std::runtime_error("Trajectory has no index, the recording did not finish");
+    if(footer.indexOffset < sizeof(header) || footer.frameCount > (size - sizeof(footer) - footer.indexOffset) / sizeof(trajectoryIndexEntry)
+        || footer.indexOffset + footer.frameCount * sizeof(trajectoryIndexEntry) + sizeof(footer) != size)
+        throw std::runtime_error("Trajectory index is corrupt");
+
+    frameCount = footer.frameCount;
+    index.resize(frameCount);
+    memcpy(index.data(), data + footer.indexOffset, frameCount * sizeof(trajectoryIndexEntry));
+    for(const trajectoryIndexEntry& entry : index) {
+        if(entry.offset < sizeof(header) || entry.offset + sizeof(trajectoryChunk) > footer.indexOffset)
+            throw std::runtime_error("Trajectory index is corrupt");
+    }
+    cols = (int)std::ceil(header.width / header.cellSize) + 1;
+    decodedFrame = -1;
+}
+
+const trajectoryHeader& trajectoryReader::getHeader() const {
+    return header;
+}
+
+size_t trajectoryReader::getFrameCount() const {
+    return frameCount;
+}
+
+long trajectoryReader::getStep(size_t frame) const {
+    return index[frame].step;
+}
+
+int trajectoryReader::getParticleCount(size_t frame) const {
+    trajectoryChunk c;
+    memcpy(&c, file.getData() + index[frame].offset, sizeof(c));
+    return c.particleCount;
+}
+
+void trajectoryReader::decodeFrame(size_t frame) {
+    const char* data = file.getData();
+    const size_t end = frame + 1 < frameCount ? index[frame + 1].offset : file.getSize() - sizeof(trajectoryFooter) - frameCount * sizeof(trajectoryIndexEntry);
+    trajectoryChunk c;
+    memcpy(&c, data + index[frame].offset, sizeof(c));
+    const size_t payload = index[frame].offset + sizeof(c);
+    if(c.payloadSize > end - payload || (c.keyframe != 0) != (frame % header.keyframeInterval == 0))
+        throw std::runtime_error("Trajectory frame is corrupt");
+
+    const size_t n = c.particleCount;
+    if(c.keyframe)
+        state = trajectoryState();
+    state.resize(n);
+    planes.resize(n * framePlaneCount);
+    const uint8_t* src = (const uint8_t*)data + payload;
+    size_t remaining = c.payloadSize;
+    for(int p = 0; p < framePlaneCount; p++) {
+        const size_t used = ransDecode(src, remaining, planes.data() + p * n, n);
+        if(used == 0)
+            throw std::runtime_error("Trajectory frame is corrupt");
+        src += used;
+        remaining -= used;
+    }
+
+    const uint8_t* plane = planes.data();
+    for(size_t i = 0; i < n; i++) {
+        uint32_t dc = 0;
+        for(int b = 0; b < 4; b++)
+            dc |= (uint32_t)plane[b * n + i] << (8 * b);
+        state.cells[i] = (int32_t)((uint32_t)state.cells[i] + (uint32_t)unzigzag(dc));
+        for(int a = 0; a < 2; a++) {
+            state.offsets[2 * i + a] += plane[(4 + a) * n + i];
+            uint32_t dv = 0;
+            for(int b = 0; b < 4; b++)
+                dv |= (uint32_t)plane[(6 + 4 * a + b) * n + i] << (8 * b);
+            state.velocities[2 * i + a] = (int32_t)((uint32_t)state.velocities[2 * i + a] + (uint32_t)unzigzag(dv));
+        }
+    }
+}
+
+void trajectoryReader::readFrame(size_t frame, std::vector<glm::vec2>& positions, std::vector<glm::vec2>& velocities) {
+    if(frame >= frameCount)
+        throw std::runtime_error("Trajectory frame out of range");
+    if((long)frame != decodedFrame) {
+        const size_t keyframe = frame - frame % header.keyframeInterval;
+        size_t first = keyframe;
+        if(decodedFrame >= (long)keyframe && decodedFrame < (long)frame)
+            first = decodedFrame + 1;
+        // a failed decode leaves the state unusable as a reference
+        decodedFrame = -1;
+        for(size_t f = first; f <= frame; f++)
+            decodeFrame(f);
+        decodedFrame = frame;
+    }
+
+    const size_t n = state.cells.size();
+    const float scale = header.cellSize / 256.0f;
+    positions.resize(n);
+    velocities.resize(n);
+    for(size_t i = 0; i < n; i++) {
+        const int32_t cx = state.cells[i] % cols, cy = state.cells[i] / cols;
+        positions[i].x = (((cx << 8) | state.offsets[2 * i]) + 0.5f) * scale;
+        positions[i].y = (((cy << 8) | state.offsets[2 * i + 1]) + 0.5f) * scale;
+        velocities[i] = glm::vec2(state.velocities[2 * i], state.velocities[2 * i + 1]) * header.velQuantum;
+    }
+}
@@ -0,0 +1,160 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "glm/glm.hpp"
+#include "checkpoint.h"
+
+/*
+    Trajectory file, native byte order:
+        trajectoryHeader
+        frames      per recorded substep a trajectoryChunk followed by its coded planes
+        index       frameCount trajectoryIndexEntry, the file offset of every chunk
+        trajectoryFooter
+    Positions are stored as the index of their grid cell plus an 8-bit offset
+    inside it per axis, velocities as integer multiples of velQuantum. Each
+    particle is coded as the difference to its own values in the previous
+    frame, or to zero in a keyframe (every keyframeInterval-th frame), and
+    every byte of those differences goes to one of framePlaneCount planes
+    that is coded separately with rANS:
+        cell index delta    4 planes, zigzag coded
+        offset delta x, y   1 plane each, modulo 256
+        velocity delta x, y 4 planes each, zigzag coded
+    A particle at rest codes to zeros in every plane, which costs next to nothing.
+*/
+struct trajectoryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    int32_t width, height;
+    float cellSize;
+    float velQuantum;
+    int32_t stride;
+    int32_t keyframeInterval;
+};
+
+struct trajectoryChunk {
+    int64_t step;
+    uint32_t particleCount;
+    uint32_t keyframe;
+    uint64_t payloadSize;
+};
+
+struct trajectoryIndexEntry {
+    int64_t step;
+    uint64_t offset;
+};
+
+struct trajectoryFooter {
+    uint64_t indexOffset;
+    uint64_t frameCount;
+    char magic[8];
+};
+
+const char trajectoryMagic[8] = { 'F', 'S', 'I', 'M', 'T', 'R', 'A', 'J' };
+// version 2 adds stored blocks for planes that do not compress, version 1 files still read
+const uint32_t trajectoryVersion = 2;
+const int framePlaneCount = 14;
+
+// quantized state of every particle in a frame, the reference the next frame is coded against
+struct trajectoryState {
+    std::vector<int32_t> cells;
+    std::vector<uint8_t> offsets;
+    std::vector<int32_t> velocities;
+
+    void resize(size_t n);
+};
+
+/*
+    Records every stride-th substep. beginFrame() hands out one of a fixed
+    number of buffers for the caller to fill with the particle state, and
+    commitFrame() queues it for the writer thread, which quantizes, codes and
+    writes it. Frames are never dropped: when every buffer is queued,
+    beginFrame() waits for the writer.
+*/
+class trajectoryWriter {
+private:
+    struct frame {
+        long step;
+        int count;
+        // x, y, vx, vy per particle
+        std::vector<float> data;
+    };
+
+    std::string path;
+    trajectoryHeader header;
+    int cols;
+
+    std::vector<frame> buffers;
+    std::deque<int> freeBuffers;
+    std::deque<int> queuedBuffers;
+    int filling = -1;
+    std::mutex mutex;
+    std::condition_variable bufferFreed;
+    std::condition_variable frameQueued;
+    std::thread writer;
+    bool stopping = false;
+
+    FILE* out = nullptr;
+    uint64_t offset = 0;
+    std::vector<trajectoryIndexEntry> index;
+    long particleFrames = 0;
+    bool failed = false;
+
+    void writeLoop();
+    bool writeFrame(const frame& f, trajectoryState& prev, std::vector<uint8_t>& planes, std::vector<uint8_t>& chunk);
+    bool writeBytes(const void* data, size_t size);
+
+public:
+    trajectoryWriter(const char* path, int width, int height, float cellSize, float velQuantum, int stride, int keyframeInterval, int queueSize);
+    ~trajectoryWriter();
+
+    // creates the file and starts the writer, returns false if the file cannot be created
+    bool start();
+    int getStride() const;
+
+    // returns room for count particles as x, y, vx, vy, to be filled before commitFrame()
+    float* beginFrame(long step, int count);
+    void commitFrame();
+    // writes the queued frames and the index, and closes the file
+    void finish();
+
+    long getWritten() const;
+    uint64_t getBytes() const;
+    // mean file size per particle and frame
+    double getBytesPerParticle() const;
+    bool hasFailed() const;
+};
+
+// random access to the frames of a trajectory file, throws std::runtime_error on malformed files
+class trajectoryReader {
+private:
+    mappedFile file;
+    trajectoryHeader header;
+    std::vector<trajectoryIndexEntry> index;
+    size_t frameCount = 0;
+    int cols;
+
+    trajectoryState state;
+    std::vector<uint8_t> planes;
+    long decodedFrame = -1;
+
+    void decodeFrame(size_t frame);
+
+public:
+    void open(const char* path);
+
+    const trajectoryHeader& getHeader() const;
+    size_t getFrameCount() const;
+    long getStep(size_t frame) const;
+    int getParticleCount(size_t frame) const;
+
+    // decodes from the last keyframe at or before frame, or continues from the previous read if frame follows it
+    void readFrame(size_t frame, std::vector<glm::vec2>& positions, std::vector<glm::vec2>& velocities);
+};
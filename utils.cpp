@@ -1,36 +1,40 @@
 #include <iostream>
 #include <stdexcept>
 #include <sstream>
-#include <unordered_set>
+#include <unordered_map>
 #include <unistd.h>
 #include <libconfig.h++>
 #include "utils.h"
 #include "global.h"
 
 libconfig::Config utilsConfig::cfg;
-float utilsConfig::bounceCoeff;
-float utilsConfig::groundBounceCoeff;
 
 void utilsConfig::parseConfig() {
     ::parseConfig(cfg, utilsConfigPath);
 }
 
-void utilsConfig::readConfig() {
-    bounceCoeff = cfg.lookup("bounce_coeff");
-    groundBounceCoeff = cfg.lookup("ground_bounce_coeff");
-}
-
-bool getOption(int argc, char** argv, char opt) {
-    static std::unordered_set<char> opt_set;
+static const std::unordered_map<char, const char*>& parseOptions(int argc, char** argv) {
+    static std::unordered_map<char, const char*> opt_map;
     static bool parsed = false;
     if(!parsed) {
-        char c;
+        int c;
         while((c = getopt(argc, argv, argOpts)) != -1) {
-            opt_set.insert(c);
+            opt_map[c] = optarg;
         }
         parsed = true;
     }
-    return opt_set.find(opt) != opt_set.end();
+    return opt_map;
+}
+
+bool getOption(int argc, char** argv, char opt) {
+    const auto& opt_map = parseOptions(argc, argv);
+    return opt_map.find(opt) != opt_map.end();
+}
+
+const char* getOptionArg(int argc, char** argv, char opt) {
+    const auto& opt_map = parseOptions(argc, argv);
+    auto it = opt_map.find(opt);
+    return it != opt_map.end() ? it->second : nullptr;
 }
 
 void parseConfig(libconfig::Config& cfg, const char* configPath) {
@@ -49,22 +53,40 @@ void parseConfig(libconfig::Config& cfg, const char* configPath) {
     }
 }
 
-void resolveOutOfBounds(point& p, int w, int h) {
+// whole file as a string, empty if it cannot be read
+std::string readFileContents(const char* path) {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+// 64-bit FNV-1a, pass the previous result as hash to continue over several buffers
+uint64_t fnv1a(const void* data, size_t size, uint64_t hash) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for(size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+void resolveOutOfBounds(point& p, int w, int h, float bounceCoeff, float groundBounceCoeff) {
     if(p.pos.x > w) {
         p.pos.x = w;
-        p.vel.x *= -utConf::bounceCoeff;
+        p.vel.x *= -bounceCoeff;
     }
     if(p.pos.x < 0){
         p.pos.x = 0;
-        p.vel.x *= -utConf::bounceCoeff;
+        p.vel.x *= -bounceCoeff;
     }
     if(p.pos.y > h - 10) {
         p.pos.y = h - 10;
-        p.vel.y *= -utConf::bounceCoeff * utConf::groundBounceCoeff;
+        p.vel.y *= -bounceCoeff * groundBounceCoeff;
     }
     if(p.pos.y < 0) {
         p.pos.y = 0;
-        p.vel.y *= -utConf::bounceCoeff;
+        p.vel.y *= -bounceCoeff;
     }
 }
 
@@ -1,5 +1,7 @@
 #pragma once
 #include <fstream>
+#include <string>
+#include <cstdint>
 #include <vector>
 #include <libconfig.h++>
 #include "glm/glm.hpp"
@@ -11,7 +13,9 @@ struct point {
     glm::ivec2 gridIdx;
     float density;
     float pressure;
-    bool locked;
+    bool locked;        // particle is at rest and skipped by the solver
+    bool disturbed;     // a moving neighbour asked to wake this particle up
+    int restSteps;      // consecutive substeps spent below the rest thresholds
 };
 
 struct segment {
@@ -22,16 +26,16 @@ struct segment {
 class utilsConfig {
 public:
     static libconfig::Config cfg;
-    static float bounceCoeff;
-    static float groundBounceCoeff;
 
     static void parseConfig();
-    static void readConfig();
 };
 
 typedef utilsConfig utConf;
 
 bool getOption(int argc, char** argv, char opt);
+const char* getOptionArg(int argc, char** argv, char opt);
 void parseConfig(libconfig::Config& cfg, const char* configPath);
-void resolveOutOfBounds(point& p, int w, int h);
+std::string readFileContents(const char* path);
+uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL);
+void resolveOutOfBounds(point& p, int w, int h, float bounceCoeff, float groundBounceCoeff);
 void resolveVelocity(const glm::vec2& p, glm::vec2& v, const int& height);
\ No newline at end of file